@@ -19,7 +19,8 @@ extern "C" {
 
 namespace Codec {
 
-    enum NCodecMode { SW_CODEC = 0, VAAPI_CODEC, QSV_CODEC, CODEC_MODE_INVAILD };
+    // VAAPI_EMU_CODEC：没有vaapi设备的机器上用软件模拟vaapi编码的surface池和上传
+    enum NCodecMode { SW_CODEC = 0, VAAPI_CODEC, QSV_CODEC, VAAPI_EMU_CODEC, CODEC_MODE_INVAILD };
 
     static BasicEncoder::Ptr CreateEncoder(NCodecMode mode, int chn) {
         switch (mode) {
@@ -32,6 +33,11 @@ namespace Codec {
         case QSV_CODEC: {
             return std::make_shared<QSVEncoder>(chn);
         } break;
+        case VAAPI_EMU_CODEC: {
+            auto encoder = std::make_shared<VAAPIEncoder>(chn);
+            encoder->setEmulated(true);
+            return encoder;
+        } break;
         default:
             break;
         }
@@ -50,6 +56,10 @@ namespace Codec {
         case QSV_CODEC: {
             return std::make_shared<QSVDecoder>(chn);
         } break;
+        case VAAPI_EMU_CODEC: {
+            // 解码没有模拟后端，用软件解码
+            return std::make_shared<SwDecoder>(chn);
+        } break;
         default:
             break;
         }
@@ -5,6 +5,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 #include "common.hpp"
+#include "h264bs.hpp"
 
 #include <memory>
 
@@ -30,7 +31,109 @@ namespace Codec {
 
         virtual AVBufferRef *getHwFramesCtx() = 0;
 
+        // 收到带时延测量SEI的packet时回调，latency_us为当前系统时间减去SEI里的编码时刻
+        using LatencyCallback =
+            std::function<void(uint64_t pktid, const H264_BS::LatencyInfo &info, int64_t latency_us)>;
+
+        void setLatencyCallback(LatencyCallback callback) {
+            latency_callback_ = std::move(callback);
+        }
+
+        struct DecodeMetrics {
+            uint64_t packets   = 0; // 收到的packet
+            uint64_t frames    = 0; // 解码输出的帧
+            uint64_t errors    = 0; // 送包或解码出错的次数
+            uint64_t gaps      = 0; // pktid不连续（丢包）的次数
+            uint64_t discarded = 0; // 等待IDR期间丢掉、没有送进解码器的packet
+            uint64_t resyncs   = 0; // 在IDR处复位解码器恢复解码的次数
+        };
+
+        /**
+         * @brief 开启后解码出错或pktid不连续时，丢弃后续packet直到下一个IDR（H265为IRAP），
+         * 再复位解码器从IDR开始解码，不把CPU浪费在错误隐藏和花屏帧上；pktid需要按包序号连续递增
+         */
+        void setResync(bool enable) {
+            resync_ = enable;
+        }
+
+        const DecodeMetrics &metrics() const {
+            return metrics_;
+        }
+
+    protected:
+        typedef enum {
+            RESYNC_PASS    = 0, // 正常送入解码器
+            RESYNC_DISCARD = 1, // 丢弃
+            RESYNC_RESUME  = 2, // 等到了IDR，复位解码器后送入
+        } ResyncAction;
+
+        void setCodecType(AVCodecID codecID) {
+            nal_codec_ = codecID == AV_CODEC_ID_HEVC ? H264_BS::CODEC_H265 : H264_BS::CODEC_H264;
+        }
+
+        // 每个packet送入解码器之前调用，决定这个packet怎么处理
+        ResyncAction resyncCheck(uint64_t pktid, const uint8_t *data, size_t size) {
+            metrics_.packets++;
+            bool gap        = has_last_pktid_ && pktid != last_pktid_ + 1;
+            has_last_pktid_ = true;
+            last_pktid_     = pktid;
+            if (gap) {
+                metrics_.gaps++;
+            }
+            if (!resync_) {
+                return RESYNC_PASS;
+            }
+            if (gap && !waiting_idr_) {
+                LOG_CHN(WARN, chn_) << "packet gap before " << pktid << ", wait for next idr" << std::endl;
+                waiting_idr_ = true;
+            }
+            if (!waiting_idr_) {
+                return RESYNC_PASS;
+            }
+
+            bool irap = false;
+            H264_BS::MediaDetector::forEachNal(data, size, 0, [&](const unsigned char *nal, size_t) {
+                int type = H264_BS::MediaDetector::getNalType(nal, nal_codec_);
+                irap     = H264_BS::MediaDetector::isIrap(type, nal_codec_);
+                return !irap;
+            });
+            if (!irap) {
+                metrics_.discarded++;
+                return RESYNC_DISCARD;
+            }
+            waiting_idr_ = false;
+            metrics_.resyncs++;
+            return RESYNC_RESUME;
+        }
+
+        // 送包或取帧出错
+        void resyncOnError() {
+            metrics_.errors++;
+            if (resync_ && !waiting_idr_) {
+                LOG_CHN(WARN, chn_) << "decode error, wait for next idr" << std::endl;
+                waiting_idr_ = true;
+            }
+        }
+
+    protected:
+        // 送入解码器之前检查packet里的时延SEI
+        void checkLatencySei(uint64_t pktid, const uint8_t *data, size_t size) {
+            H264_BS::LatencyInfo info;
+            if (latency_callback_ && H264_BS::LatencySei::find(data, size, 0, info)) {
+                latency_callback_(pktid, info, H264_BS::LatencySei::wallclockUs() - info.wallclock_us);
+            }
+        }
+
     protected:
         int chn_ = -1;
+
+        LatencyCallback latency_callback_ = nullptr;
+
+        H264_BS::CodecType nal_codec_      = H264_BS::CODEC_H264;
+        bool               resync_         = false;
+        bool               waiting_idr_    = false;
+        bool               has_last_pktid_ = false;
+        uint64_t           last_pktid_     = 0;
+        DecodeMetrics      metrics_;
     };
 } // namespace Codec
\ No newline at end of file
@@ -136,6 +136,7 @@ namespace Codec {
                 break;
             }
 
+            setCodecType(codecID);
             callback_ = std::move(callback);
             LOG_CHN(INFO, chn_) << "qsv decoder init done";
             return 0;
@@ -147,6 +148,14 @@ namespace Codec {
     int QSVDecoder::decode(uint64_t pktid, FGRecord::AVPacketSP fgpkt) {
         AVPacket *packet = nullptr;
         if (fgpkt) {
+            ResyncAction action = resyncCheck(pktid, fgpkt->data.get(), fgpkt->size);
+            if (action == RESYNC_DISCARD) {
+                return 0;
+            }
+            if (action == RESYNC_RESUME) {
+                avcodec_flush_buffers(pDecodec_ctx_);
+            }
+
             packet = av_packet_alloc();
             if (NULL == packet) {
                 LOG_CHN(ERROR, chn_) << "av_packet_alloc fail.";
@@ -155,12 +164,17 @@ namespace Codec {
             packet->size = fgpkt->size;
             packet->data = !fgpkt->size ? NULL : fgpkt->data.get();
             packet->pts  = fgpkt->timestamp;
+            checkLatencySei(pktid, packet->data, packet->size);
         }
 
         int ret = avcodec_send_packet(pDecodec_ctx_, packet);
+        av_packet_free(&packet);
         if (ret < 0) {
             av_strerror(ret, errStr, sizeof(errStr));
             LOG_CHN(ERROR, chn_) << "avcodec_send_packet err: " << errStr;
+            if (fgpkt) {
+                resyncOnError();
+            }
             return -1;
         }
 
@@ -176,8 +190,10 @@ namespace Codec {
             else if (ret < 0) {
                 av_strerror(ret, errStr, sizeof(errStr));
                 LOG_CHN(ERROR, chn_) << "decoder failed, " << errStr << std::endl;
+                resyncOnError();
                 break;
             }
+            metrics_.frames++;
             if (callback_) {
                 callback_(pktid, frame);
             }
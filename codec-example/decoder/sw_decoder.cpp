@@ -38,6 +38,7 @@ namespace Codec {
             return -1;
         }
 
+        setCodecType(codecID);
         callback_ = std::move(callback);
         LOG_CHN(INFO, chn_) << "sw decoder init done";
         return 0;
@@ -85,6 +86,15 @@ namespace Codec {
     int SwDecoder::decode(uint64_t pktid, FGRecord::AVPacketSP fgpkt) {
         int ret = 0;
         if (fgpkt) {
+            // 丢包或出错后等待IDR期间的packet不拷贝也不送进解码器
+            ResyncAction action = resyncCheck(pktid, fgpkt->data.get(), fgpkt->size);
+            if (action == RESYNC_DISCARD) {
+                return 0;
+            }
+            if (action == RESYNC_RESUME) {
+                avcodec_flush_buffers(pDecodec_ctx_);
+            }
+
             auto     depkt = av_packet_alloc();
             uint8_t *dat   = (uint8_t *)av_malloc(fgpkt->size);
             if (dat == nullptr) {
@@ -101,11 +111,14 @@ namespace Codec {
             }
             // 为了AVFrame的时间戳能和AVPacket对应
             depkt->pts = fgpkt->timestamp;
+            checkLatencySei(pktid, depkt->data, depkt->size);
 
             ret = avcodec_send_packet(pDecodec_ctx_, depkt);
+            av_packet_free(&depkt);
             if (ret < 0) {
                 av_strerror(ret, errStr, sizeof(errStr));
                 LOG_CHN(ERROR, chn_) << "decoder send packet failed, " << errStr << std::endl;
+                resyncOnError();
                 return -1;
             }
         } else {
@@ -126,8 +139,10 @@ namespace Codec {
             else if (ret < 0) {
                 av_strerror(ret, errStr, sizeof(errStr));
                 LOG_CHN(ERROR, chn_) << "decoder failed, " << errStr << std::endl;
+                resyncOnError();
                 break;
             }
+            metrics_.frames++;
             if (callback_) {
                 callback_(pktid, frame);
             }
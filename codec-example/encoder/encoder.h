@@ -4,10 +4,13 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 }
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
 #include "common.hpp"
+#include "h264bs.hpp"
+#include "roi.hpp"
 
 namespace Codec {
     class BasicEncoder {
@@ -25,14 +28,107 @@ namespace Codec {
 
         virtual int encode(uint64_t frameid, AVFrame *inframe) = 0;
 
+        // 带这一帧的ROI提示（比如运动区域）编码，提示排在通道的ROI前面，重叠时优先
+        int encode(uint64_t frameid, AVFrame *inframe, const std::vector<RoiRegion> &hints) {
+            roi_hints_ = &hints;
+            int ret    = encode(frameid, inframe);
+            roi_hints_ = nullptr;
+            return ret;
+        }
+
         virtual int flush(uint64_t frameid) = 0;
 
         virtual int close() = 0;
 
         virtual bool isopend() = 0;
 
+        // 编码器在通道之间复用时改成新通道的号，只用于日志
+        void setChannel(int chn) {
+            chn_ = chn;
+        }
+
+        // 通道固定的ROI，每一帧都生效，比如降低天空、叠加的时间戳的质量
+        void setRoi(std::vector<RoiRegion> regions) {
+            roi_ = std::move(regions);
+        }
+
+        // 在每个输出的packet里插入时延测量SEI（序号和编码完成时刻），只对Annex-B格式的H264有效，
+        // 其他编码（比如hevc_vaapi）的packet原样输出
+        void setLatencySei(bool enable) {
+            latency_sei_ = enable;
+        }
+
+    protected:
+        // 送编码器之前调用，把这一帧的提示和通道的ROI挂到帧上，帧上已经有ROI时不动；
+        // 返回true时送完要detachRoi，调用者的帧保持原样
+        bool attachRoi(AVFrame *frame) {
+            bool hints = roi_hints_ && !roi_hints_->empty();
+            if (frame == nullptr || (!hints && roi_.empty()) ||
+                av_frame_get_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST)) {
+                return false;
+            }
+            if (!hints) {
+                return attachRoiSideData(frame, roi_) > 0;
+            }
+            std::vector<RoiRegion> regions(*roi_hints_);
+            regions.insert(regions.end(), roi_.begin(), roi_.end());
+            return attachRoiSideData(frame, regions) > 0;
+        }
+
+        void detachRoi(AVFrame *frame) {
+            av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+        }
+
+        // 编码器回调之前调用，SEI放在第一个slice之前；
+        // NAL按H264解析、SEI是H264格式，H265的NAL头不同，插进去会破坏码流，所以只处理H264
+        int insertLatencySei(AVPacket *pkt, AVCodecID codec) {
+            if (codec != AV_CODEC_ID_H264) {
+                return -1;
+            }
+            const uint8_t *vcl = nullptr;
+            Utils::forEachNal(pkt->data, pkt->size, 0, [&](const Utils::NalUnit &nal) {
+                if (H264_BS::MediaDetector::isSlice(H264_BS::MediaDetector::getNalType(nal.data))) {
+                    // 插入点在slice的start code之前，最多带一个前导0
+                    vcl = nal.data - (nal.prefix < 4 ? nal.prefix : 4);
+                    return false;
+                }
+                return true;
+            });
+            if (vcl == nullptr) {
+                return -1;
+            }
+            size_t pos = vcl - pkt->data;
+
+            H264_BS::LatencyInfo info;
+            info.sequence     = latency_seq_++;
+            info.wallclock_us = H264_BS::LatencySei::wallclockUs();
+            info.monotonic_us = H264_BS::LatencySei::monotonicUs();
+            std::vector<uint8_t> sei = H264_BS::LatencySei::build(info);
+
+            AVBufferRef *buf = av_buffer_alloc(pkt->size + sei.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (buf == nullptr) {
+                return -1;
+            }
+            memcpy(buf->data, pkt->data, pos);
+            memcpy(buf->data + pos, sei.data(), sei.size());
+            memcpy(buf->data + pos + sei.size(), pkt->data + pos, pkt->size - pos);
+            memset(buf->data + pkt->size + sei.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+            av_buffer_unref(&pkt->buf);
+            pkt->buf  = buf;
+            pkt->data = buf->data;
+            pkt->size += (int)sei.size();
+            return 0;
+        }
+
     protected:
         int chn_ = 1;
+
+        bool     latency_sei_ = false;
+        uint64_t latency_seq_ = 0;
+
+        std::vector<RoiRegion>        roi_;
+        const std::vector<RoiRegion> *roi_hints_ = nullptr;
     };
 
 } // namespace Codec
\ No newline at end of file
@@ -131,7 +131,11 @@ namespace Codec {
     }
 
     int QSVEncoder::encode(uint64_t frameid, AVFrame *inframe) {
-        int ret = avcodec_send_frame(encodec_ctx_, inframe);
+        bool roi = attachRoi(inframe);
+        int  ret = avcodec_send_frame(encodec_ctx_, inframe);
+        if (roi) {
+            detachRoi(inframe);
+        }
         if (ret < 0) {
             av_strerror(ret, errStr, sizeof(errStr));
             LOG_CHN(ERROR, chn_) << "Error during encoding. Error code: " << errStr;
@@ -149,6 +153,9 @@ namespace Codec {
                 break;
             }
 
+            if (latency_sei_) {
+                insertLatencySei(out_pkt, encodec_ctx_->codec_id);
+            }
             if (callback_) {
                 if (inframe) {
                     out_pkt->pts = inframe->pts;
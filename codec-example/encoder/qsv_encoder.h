@@ -20,6 +20,7 @@ namespace Codec {
                          int height, EncodeCallback callback);
 
         virtual int encode(uint64_t frameid, AVFrame *inframe);
+        using BasicEncoder::encode;
 
         virtual int flush(uint64_t frameid);
 
@@ -39,6 +39,12 @@ namespace Codec {
         pEncodec_ctx_->gop_size              = 30;
         pEncodec_ctx_->max_b_frames          = 0;
         pEncodec_ctx_->has_b_frames          = 0;
+        pEncodec_ctx_->profile               = profile_;
+
+        if (skip_mode_ != SKIP_NONE && !SceneDetector::supported(inPixel)) {
+            LOG_CHN(WARN, chn_) << "static skip needs 8bit planar luma, disabled";
+            skip_mode_ = SKIP_NONE;
+        }
 
         // 不缓存帧
         av_opt_set(pEncodec_ctx_->priv_data, "tune", "zerolatency", 0);
@@ -62,12 +68,116 @@ namespace Codec {
             avcodec_close(pEncodec_ctx_);
             avcodec_free_context(&pEncodec_ctx_);
         }
+        av_frame_free(&last_);
+        detector_.reset();
+        reportSkipStats();
+        return 0;
+    }
+
+    void SwEncoder::reportSkipStats() {
+        if (skip_stats_.frames > 0) {
+            LOG_CHN(INFO, chn_) << "frames: " << skip_stats_.frames << ", encoded: " << skip_stats_.encoded
+                                << ", dropped: " << skip_stats_.dropped << ", repeated: " << skip_stats_.repeated
+                                << ", skip ratio: "
+                                << (double)(skip_stats_.dropped + skip_stats_.repeated) / skip_stats_.frames;
+        }
+        skip_stats_ = SkipStats();
+    }
+
+    int SwEncoder::reset() {
+        if (!encoder_opened_ || !(pEncodec_->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+            return -1;
+        }
+        // 也清掉flush()之后的EOF状态，可以继续送帧
+        avcodec_flush_buffers(pEncodec_ctx_);
+        force_idr_   = true;
+        latency_seq_ = 0;
+        callback_    = nullptr;
+        // ROI和时延SEI是上一个通道的配置，新通道需要时自己再设
+        roi_.clear();
+        latency_sei_ = false;
+        skipped_     = 0;
+        // 池里的编码器一般reset后复用而不是close，上一个通道的统计在这里输出
+        reportSkipStats();
+        detector_.reset();
         return 0;
     }
 
+    static void clearSideData(AVFrame *frame) {
+        while (frame->nb_side_data > 0) {
+            av_frame_remove_side_data(frame, frame->side_data[0]->type);
+        }
+    }
+
+    AVFrame *SwEncoder::skipStatic(AVFrame *inframe) {
+        skip_stats_.frames++;
+        bool keep = force_idr_ || inframe->pict_type == AV_PICTURE_TYPE_I || skipped_ >= max_skip_ ||
+                    detector_.changed(inframe);
+        if (keep) {
+            skipped_ = 0;
+            skip_stats_.encoded++;
+            detector_.update(inframe);
+            if (skip_mode_ == SKIP_REPEAT) {
+                // 编码器会拷贝输入，调用者的缓冲可能被复用，这里留一份
+                if (last_ == nullptr) {
+                    last_ = av_frame_alloc();
+                }
+                if (last_ && (last_->width != inframe->width || last_->height != inframe->height ||
+                              last_->format != inframe->format)) {
+                    av_frame_unref(last_);
+                    last_->width  = inframe->width;
+                    last_->height = inframe->height;
+                    last_->format = inframe->format;
+                    if (av_frame_get_buffer(last_, 0) < 0) {
+                        av_frame_free(&last_);
+                    }
+                }
+                if (last_ && av_frame_copy(last_, inframe) < 0) {
+                    av_frame_free(&last_);
+                }
+                if (last_) {
+                    clearSideData(last_);
+                }
+            }
+            return inframe;
+        }
+
+        skipped_++;
+        if (skip_mode_ == SKIP_REPEAT && last_) {
+            // 内容还是上一个编码的帧，时间戳等属性用当前帧的；
+            // av_frame_copy_props是追加side data，先清掉上一次重复时带上的
+            clearSideData(last_);
+            av_frame_copy_props(last_, inframe);
+            skip_stats_.repeated++;
+            return last_;
+        }
+        skip_stats_.dropped++;
+        return nullptr;
+    }
+
     int SwEncoder::encode(uint64_t frameid, AVFrame *inframe) {
+        if (inframe && skip_mode_ != SKIP_NONE) {
+            inframe = skipStatic(inframe);
+            if (inframe == nullptr) {
+                return 0;
+            }
+        }
 
-        int ret = avcodec_send_frame(pEncodec_ctx_, inframe);
+        bool roi = attachRoi(inframe);
+        int  ret = 0;
+        if (force_idr_ && inframe) {
+            // 新通道的第一帧，不改调用者的帧
+            AVPictureType pict_type = inframe->pict_type;
+            inframe->pict_type      = AV_PICTURE_TYPE_I;
+            ret                     = avcodec_send_frame(pEncodec_ctx_, inframe);
+            inframe->pict_type      = pict_type;
+            force_idr_              = false;
+        } else {
+            ret = avcodec_send_frame(pEncodec_ctx_, inframe);
+        }
+        if (roi) {
+            detachRoi(inframe);
+        }
         if (ret < 0) {
             av_strerror(ret, errStr, sizeof(errStr));
             LOG_CHN(ERROR, chn_) << "encoder send frame failed, " << errStr;
@@ -86,6 +196,9 @@ namespace Codec {
                 break;
             }
 
+            if (latency_sei_) {
+                insertLatencySei(pkt, pEncodec_ctx_->codec_id);
+            }
             if (callback_) {
                 callback_(frameid, pkt);
             }
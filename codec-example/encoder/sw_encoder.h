@@ -4,6 +4,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 #include "encoder.h"
+#include "scene_detector.hpp"
 
 #include <functional>
 #include <string>
@@ -15,6 +16,16 @@ extern "C" {
 namespace Codec {
     class SwEncoder : public BasicEncoder {
     public:
+        using Ptr = std::shared_ptr<SwEncoder>;
+
+        // 静止画面跳过的统计，frames为送进来的帧数
+        struct SkipStats {
+            uint64_t frames   = 0;
+            uint64_t encoded  = 0;
+            uint64_t dropped  = 0;
+            uint64_t repeated = 0;
+        };
+
         explicit SwEncoder(int chn)
             : BasicEncoder(chn){};
         virtual ~SwEncoder(){};
@@ -25,6 +36,7 @@ namespace Codec {
                          int height, EncodeCallback callback);
 
         virtual int encode(uint64_t frameid, AVFrame *inframe);
+        using BasicEncoder::encode;
 
         virtual int flush(uint64_t frameid);
 
@@ -32,6 +44,38 @@ namespace Codec {
 
         virtual bool isopend();
 
+        // FF_PROFILE_*，open之前设置，默认由编码器决定
+        void setProfile(int profile) {
+            profile_ = profile;
+        }
+
+        // 换一个通道继续用已经打开的编码器：丢掉缓存的帧，下一帧强制IDR，清掉通道的回调、ROI和时延SEI设置；
+        // 编码器不支持flush（AV_CODEC_CAP_ENCODER_FLUSH）时返回-1，只能关掉重开
+        int reset();
+
+        void setCallback(EncodeCallback callback) {
+            callback_ = std::move(callback);
+        }
+
+        // 编码前检测静止画面，threshold见SCENE_DIFF_THRESHOLD，
+        // 连续跳过max_skip帧后不管有没有变化都编码一帧；open之前设置
+        void setStaticSkip(StaticSkipMode mode, int threshold = SCENE_DIFF_THRESHOLD, int max_skip = SCENE_MAX_SKIP) {
+            skip_mode_ = mode;
+            max_skip_  = max_skip > 0 ? max_skip : 1;
+            detector_.setThreshold(threshold);
+        }
+
+        const SkipStats &skipStats() const {
+            return skip_stats_;
+        }
+
+    private:
+        // 返回要送给编码器的帧，nullptr为丢弃
+        AVFrame *skipStatic(AVFrame *inframe);
+
+        // 输出当前通道的跳帧统计并清零，close和reset时调用
+        void reportSkipStats();
+
     private:
         // encoder
         const AVCodec  *pEncodec_     = nullptr;
@@ -39,5 +83,15 @@ namespace Codec {
 
         bool           encoder_opened_ = false;
         EncodeCallback callback_       = nullptr;
+
+        int  profile_   = FF_PROFILE_UNKNOWN;
+        bool force_idr_ = false;
+
+        StaticSkipMode skip_mode_ = SKIP_NONE;
+        int            max_skip_  = SCENE_MAX_SKIP;
+        int            skipped_   = 0;       // 连续跳过的帧数
+        AVFrame       *last_      = nullptr; // SKIP_REPEAT时上一个编码的帧
+        SceneDetector  detector_;
+        SkipStats      skip_stats_;
     };
 } // namespace Codec
\ No newline at end of file
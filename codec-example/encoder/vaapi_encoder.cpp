@@ -9,10 +9,16 @@ extern "C" {
 #include <libavutil/pixdesc.h>
 }
 
+#include <algorithm>
+#include <chrono>
 
 namespace Codec {
     static char errStr[1024];
 
+    static double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
     int VAAPIEncoder::open(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
                            int height, EncodeCallback callback) {
 
@@ -37,21 +43,37 @@ namespace Codec {
         int ret         = 0;
 
         do {
+            if (emulated_) {
+                // 软件编码器直接吃内存帧，surface池见openEmulated
+                hw_format_      = inPixel;
+                hw_device_type_ = AV_HWDEVICE_TYPE_NONE;
+                if (openEmulated(codecID, inPixel, hw_frame_ctx, width, height) < 0) {
+                    break;
+                }
+                enc_name = std::string(encodec_->name) + "(emulated vaapi)";
+            }
+
             // find encoder
-            encodec_ = avcodec_find_encoder_by_name(enc_name.c_str());
+            if (encodec_ == nullptr) {
+                encodec_ = avcodec_find_encoder_by_name(enc_name.c_str());
+            }
             if (encodec_ == nullptr) {
                 LOG_CHN(ERROR, chn_) << "encoder not find, " << enc_name;
                 break;
             }
 
             // encoder ctx alloc and init
-            encodec_ctx_ = avcodec_alloc_context3(encodec_);
+            if (encodec_ctx_ == nullptr) {
+                encodec_ctx_ = avcodec_alloc_context3(encodec_);
+            }
             if (encodec_ctx_ == nullptr) {
                 LOG_CHN(ERROR, chn_) << "codec ctx alloc failed";
                 break;
             }
 
-            if (hw_frame_ctx == nullptr) {
+            if (emulated_) {
+                // 模拟后端没有frames ctx，编码器的输入就是池里的内存帧
+            } else if (hw_frame_ctx == nullptr) {
                 // frame must is software data
                 // hw device create
                 ret = av_hwdevice_ctx_create(&device_ctx_ref_, hw_device_type_, NULL, NULL, 0);
@@ -74,7 +96,7 @@ namespace Codec {
                 hw_frames_ctx->sw_format         = inPixel;
                 hw_frames_ctx->width             = width;
                 hw_frames_ctx->height            = height;
-                hw_frames_ctx->initial_pool_size = 1;
+                hw_frames_ctx->initial_pool_size = pool_size_;
 
                 ret = av_hwframe_ctx_init(hw_frames_ctx_ref_);
                 if (ret < 0) {
@@ -112,26 +134,128 @@ namespace Codec {
             return 0;
         } while (0);
 
-        if (encodec_ctx_) {
-            avcodec_free_context(&encodec_ctx_);
-            encodec_ctx_ = nullptr;
+        close();
+        return -1;
+    }
+
+    int VAAPIEncoder::openEmulated(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
+                                   int height) {
+        if (hw_frame_ctx != nullptr) {
+            LOG_CHN(ERROR, chn_) << "emulated vaapi encoder only takes software frames";
+            return -1;
+        }
+        encodec_ = avcodec_find_encoder(codecID);
+        if (encodec_ == nullptr) {
+            LOG_CHN(ERROR, chn_) << "find encoder failed, " << codecID;
+            return -1;
         }
 
-        if (hw_frames_ctx_ref_) {
-            av_buffer_unref(&hw_frames_ctx_ref_);
-            hw_frames_ctx_ref_ = nullptr;
+        // FFmpeg没有CPU类型的hwdevice，surface池用固定数量的内存帧代替：
+        // 和initial_pool_size非0的vaapi池一样不会扩容，取完了返回ENOMEM
+        for (int i = 0; i < pool_size_; i++) {
+            AVFrame *frame = av_frame_alloc();
+            if (frame == nullptr) {
+                return -1;
+            }
+            emu_pool_.push_back(frame);
+            frame->format = inPixel;
+            frame->width  = width;
+            frame->height = height;
+            int ret       = av_frame_get_buffer(frame, 0);
+            if (ret < 0) {
+                av_strerror(ret, errStr, sizeof(errStr));
+                LOG_CHN(ERROR, chn_) << "emulated surface alloc failed, " << errStr;
+                return -1;
+            }
         }
+        return 0;
+    }
 
-        if (device_ctx_ref_) {
-            av_buffer_unref(&device_ctx_ref_);
-            device_ctx_ref_ = nullptr;
+    int VAAPIEncoder::getSurface(AVFrame *surface) {
+        if (!emulated_) {
+            return av_hwframe_get_buffer(hw_frames_ctx_ref_, surface, 0);
+        }
+        // 池里的帧只剩池自己的引用就是空闲的
+        for (AVFrame *frame : emu_pool_) {
+            if (av_frame_is_writable(frame)) {
+                return av_frame_ref(surface, frame);
+            }
         }
+        return AVERROR(ENOMEM);
+    }
 
-        return -1;
+    int VAAPIEncoder::upload(AVFrame *inframe, AVFrame *surface) {
+        if (!emulated_ && (hw_frames_ctx_ref_ == nullptr || inframe->format == hw_format_)) {
+            // 外部的frames ctx或者已经是surface
+            return av_frame_ref(surface, inframe);
+        }
+
+        int ret = getSurface(surface);
+        if (ret < 0) {
+            if (ret == AVERROR(ENOMEM)) {
+                stats_.exhausted++;
+            }
+            av_strerror(ret, errStr, sizeof(errStr));
+            LOG_CHN(ERROR, chn_) << "get surface failed, pool size " << pool_size_ << ", " << errStr;
+            return ret;
+        }
+
+        if (emulated_) {
+            ret = av_frame_copy(surface, inframe);
+        } else {
+            ret = av_hwframe_transfer_data(surface, inframe, 0);
+        }
+        if (ret < 0) {
+            av_strerror(ret, errStr, sizeof(errStr));
+            LOG_CHN(ERROR, chn_) << "upload frame failed, " << errStr;
+            av_frame_unref(surface);
+            return ret;
+        }
+        return av_frame_copy_props(surface, inframe);
+    }
+
+    void VAAPIEncoder::releaseSurfaces() {
+        for (AVFrame *frame : emu_held_) {
+            av_frame_free(&frame);
+        }
+        emu_held_.clear();
     }
 
     int VAAPIEncoder::encode(uint64_t frameid, AVFrame *inframe) {
-        int ret = avcodec_send_frame(encodec_ctx_, inframe);
+        AVFrame *surface = nullptr;
+        if (inframe) {
+            surface = av_frame_alloc();
+            if (surface == nullptr) {
+                return -1;
+            }
+            auto start = std::chrono::steady_clock::now();
+            int  ret   = upload(inframe, surface);
+            stats_.upload_ms += elapsedMs(start);
+            if (ret < 0) {
+                av_frame_free(&surface);
+                return ret;
+            }
+            stats_.frames++;
+            // surface是这里的帧，送完随surface释放
+            attachRoi(surface);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        int  ret   = avcodec_send_frame(encodec_ctx_, surface);
+        if (emulated_ && surface && ret >= 0) {
+            // 软件编码器拷贝完输入就释放了，这里替它按硬件编码器的深度占着surface
+            size_t hold = std::min<size_t>(VAAPI_EMU_HOLD_SURFACES, pool_size_ - 1);
+            emu_held_.push_back(av_frame_clone(surface));
+            if (emu_held_.size() > hold && emu_held_.size() <= VAAPI_EMU_HOLD_SURFACES) {
+                // 硬件编码器这时还占着这些surface，下一帧上传要等它还回来
+                stats_.waits++;
+            }
+            while (emu_held_.size() > hold) {
+                av_frame_free(&emu_held_.front());
+                emu_held_.pop_front();
+            }
+        }
+        av_frame_free(&surface);
         if (ret < 0) {
             av_strerror(ret, errStr, sizeof(errStr));
             LOG_CHN(ERROR, chn_) << "Error during encoding. Error code: " << errStr;
@@ -149,6 +273,9 @@ namespace Codec {
                 break;
             }
 
+            if (latency_sei_) {
+                insertLatencySei(out_pkt, encodec_ctx_->codec_id);
+            }
             if (callback_) {
                 if (inframe) {
                     out_pkt->pts = inframe->pts;
@@ -159,6 +286,7 @@ namespace Codec {
         if (out_pkt) {
             av_packet_free(&out_pkt);
         }
+        stats_.encode_ms += elapsedMs(start);
         return 0;
     }
 
@@ -167,6 +295,7 @@ namespace Codec {
             encode(frameid, nullptr);
             avcodec_flush_buffers(encodec_ctx_);
         }
+        releaseSurfaces();
         return 0;
     }
 
@@ -175,6 +304,28 @@ namespace Codec {
             avcodec_close(encodec_ctx_);
             avcodec_free_context(&encodec_ctx_);
         }
+        encodec_ = nullptr;
+
+        releaseSurfaces();
+        for (AVFrame *frame : emu_pool_) {
+            av_frame_free(&frame);
+        }
+        emu_pool_.clear();
+
+        if (hw_frames_ctx_ref_) {
+            av_buffer_unref(&hw_frames_ctx_ref_);
+        }
+        if (device_ctx_ref_) {
+            av_buffer_unref(&device_ctx_ref_);
+        }
+
+        if (stats_.frames > 0) {
+            LOG_CHN(INFO, chn_) << "frames: " << stats_.frames << ", upload: " << stats_.upload_ms / stats_.frames
+                                << " ms/frame, encode: " << stats_.encode_ms / stats_.frames
+                                << " ms/frame, pool size: " << pool_size_ << ", pool exhausted: " << stats_.exhausted
+                                << ", surface waits: " << stats_.waits;
+            stats_ = SurfaceStats();
+        }
         encoder_opened_ = false;
         return 0;
     }
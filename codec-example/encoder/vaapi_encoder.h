@@ -5,21 +5,42 @@ extern "C" {
 }
 #include "encoder.h"
 
+#include <deque>
 #include <functional>
 #include <string>
+#include <vector>
 
+// 自建frames ctx时的surface数：编码器异步队列（vaapi的async_depth默认2）加参考帧，
+// 再加正在上传的下一帧，留一些余量，上传不用等上一帧编码完释放surface
+#define VAAPI_POOL_SIZE 8
+
+// 模拟后端里编码器占着不还的surface数，按async_depth 2加1个参考帧；
+// 最多占到池大小减1，总留一个给下一帧上传，小池只是变慢（记在waits里）而不是丢帧
+#define VAAPI_EMU_HOLD_SURFACES 3
 
 namespace Codec {
     class VAAPIEncoder : public BasicEncoder {
     public:
         explicit VAAPIEncoder(int chn)
             : BasicEncoder(chn){};
-        virtual ~VAAPIEncoder(){};
+        virtual ~VAAPIEncoder() {
+            close();
+        };
+
+        // 上传和编码各自的耗时，surface池用完的次数
+        struct SurfaceStats {
+            uint64_t frames    = 0;
+            uint64_t exhausted = 0;
+            uint64_t waits     = 0; // 模拟后端：池比占用深度小，真实硬件要等编码器还surface的次数
+            double   upload_ms = 0;
+            double   encode_ms = 0;
+        };
 
         virtual int open(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
                          int height, EncodeCallback callback);
 
         virtual int encode(uint64_t frameid, AVFrame *inframe);
+        using BasicEncoder::encode;
 
         virtual int flush(uint64_t frameid);
 
@@ -27,6 +48,33 @@ namespace Codec {
 
         virtual bool isopend();
 
+        // 自建frames ctx的surface数，open之前设置
+        void setPoolSize(int size) {
+            pool_size_ = size > 0 ? size : 1;
+        }
+
+        // 模拟后端：没有vaapi设备也能跑，surface是固定数量的内存帧，编码用软件编码器，
+        // 上传、surface占用和池耗尽的行为和vaapi一样，open之前设置
+        void setEmulated(bool emulated) {
+            emulated_ = emulated;
+        }
+
+        const SurfaceStats &surfaceStats() const {
+            return stats_;
+        }
+
+    private:
+        int openEmulated(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
+                         int height);
+
+        // 从池里取一个surface，池用完返回AVERROR(ENOMEM)
+        int getSurface(AVFrame *surface);
+
+        // 软件帧上传到surface，已经是硬件帧的原样送编码器
+        int upload(AVFrame *inframe, AVFrame *surface);
+
+        void releaseSurfaces();
+
     private:
         // encoder
         const AVCodec  *encodec_           = nullptr;
@@ -39,5 +87,14 @@ namespace Codec {
 
         AVPixelFormat  hw_format_      = AV_PIX_FMT_NONE;
         AVHWDeviceType hw_device_type_ = AV_HWDEVICE_TYPE_NONE;
+
+        int  pool_size_ = VAAPI_POOL_SIZE;
+        bool emulated_  = false;
+
+        // 模拟后端的surface池和编码器占着的surface
+        std::vector<AVFrame *> emu_pool_;
+        std::deque<AVFrame *>  emu_held_;
+
+        SurfaceStats stats_;
     };
-} // namespace Codec
\ No newline at end of file
+} // namespace Codec
@@ -0,0 +1,266 @@
+#include "x264_slice_encoder.h"
+
+#include <algorithm>
+
+// 8bit H264的QP范围
+#define X264_QP_RANGE 51
+
+namespace Codec {
+
+    int X264SliceEncoder::open(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
+                               int height, EncodeCallback callback) {
+        if (encoder_opened_) {
+            LOG_CHN(ERROR, chn_) << "encoder already open";
+            return -1;
+        }
+        if (codecID != AV_CODEC_ID_H264 || hw_frame_ctx != nullptr) {
+            LOG_CHN(ERROR, chn_) << "x264 slice encoder only supports software h264, " << codecID;
+            return -1;
+        }
+        switch (inPixel) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            csp_ = X264_CSP_I420;
+            break;
+        case AV_PIX_FMT_NV12:
+            csp_ = X264_CSP_NV12;
+            break;
+        default:
+            LOG_CHN(ERROR, chn_) << "unsupport pixel format, " << inPixel;
+            return -1;
+        }
+        if (callback == nullptr && slice_callback_ == nullptr) {
+            LOG_CHN(ERROR, chn_) << "callback is null, init failed";
+            return -1;
+        }
+
+        x264_param_t param;
+        if (x264_param_default_preset(&param, preset_.c_str(), "zerolatency") < 0) {
+            LOG_CHN(ERROR, chn_) << "invalid x264 preset, " << preset_;
+            return -1;
+        }
+        param.i_csp            = csp_;
+        param.i_width          = width;
+        param.i_height         = height;
+        param.i_fps_num        = 25;
+        param.i_fps_den        = 1;
+        param.i_timebase_num   = 1;
+        param.i_timebase_den   = 25;
+        param.i_keyint_max     = 30;
+        param.i_bframe         = 0;
+        param.b_repeat_headers = 1;
+        param.b_annexb         = 1;
+        param.i_log_level      = X264_LOG_WARNING;
+        // 按slice回调要求不用帧级多线程
+        param.i_threads        = threads_;
+        param.b_sliced_threads = 1;
+        param.i_slice_count    = max_bytes_ > 0 ? 0 : slices_;
+        param.i_slice_max_size = max_bytes_;
+        if (slice_callback_) {
+            param.nalu_process = onNal;
+        }
+
+        encoder_ = x264_encoder_open(&param);
+        if (encoder_ == nullptr) {
+            LOG_CHN(ERROR, chn_) << "x264 encoder open failed, " << width << "x" << height;
+            return -1;
+        }
+        width_     = width;
+        height_    = height;
+        total_mbs_ = ((width + 15) / 16) * ((height + 15) / 16);
+        pts_       = 0;
+
+        callback_       = std::move(callback);
+        encoder_opened_ = true;
+        LOG_CHN(INFO, chn_) << "x264 slice encoder init done, slices: " << (max_bytes_ > 0 ? 0 : slices_)
+                            << ", slice max bytes: " << max_bytes_;
+        return 0;
+    }
+
+    void X264SliceEncoder::onNal(x264_t *h, x264_nal_t *nal, void *opaque) {
+        X264SliceEncoder *self = (X264SliceEncoder *)opaque;
+
+        // x264要求的输出缓冲大小，编码后i_payload为实际字节数
+        std::vector<uint8_t> data(nal->i_payload * 3 / 2 + 5 + 64);
+        x264_nal_encode(h, data.data(), nal);
+        data.resize(nal->i_payload);
+
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (nal->i_type != NAL_SLICE && nal->i_type != NAL_SLICE_IDR) {
+            // SPS/PPS/SEI在所有slice之前
+            self->emit(data, nal->i_type, false);
+            return;
+        }
+        Slice &slice   = self->pending_[nal->i_first_mb];
+        slice.nal_type = nal->i_type;
+        slice.last_mb  = nal->i_last_mb;
+        slice.data.swap(data);
+        self->emitReady();
+    }
+
+    void X264SliceEncoder::emitReady() {
+        auto it = pending_.find(next_mb_);
+        while (it != pending_.end()) {
+            next_mb_ = it->second.last_mb + 1;
+            emit(it->second.data, it->second.nal_type, next_mb_ >= total_mbs_);
+            pending_.erase(it);
+            it = pending_.find(next_mb_);
+        }
+    }
+
+    void X264SliceEncoder::emit(const std::vector<uint8_t> &nal, int nal_type, bool last) {
+        if (slice_callback_) {
+            slice_callback_(frameid_, nal.data(), (int)nal.size(), nal_type, last);
+        }
+        if (callback_) {
+            frame_buf_.insert(frame_buf_.end(), nal.begin(), nal.end());
+        }
+    }
+
+    float *X264SliceEncoder::buildQuantOffsets() {
+        bool hints = roi_hints_ && !roi_hints_->empty();
+        if (!hints && roi_.empty()) {
+            return nullptr;
+        }
+        std::vector<RoiRegion> regions;
+        if (hints) {
+            regions = *roi_hints_;
+        }
+        regions.insert(regions.end(), roi_.begin(), roi_.end());
+
+        // 和libavcodec的libx264一样：qoffset乘以QP范围，重叠时前面的优先，所以倒着写
+        int mb_width = (width_ + 15) / 16;
+        quant_offsets_.assign(total_mbs_, 0.0f);
+        for (auto it = regions.rbegin(); it != regions.rend(); ++it) {
+            int   startx  = std::max(it->x, 0) / 16;
+            int   starty  = std::max(it->y, 0) / 16;
+            int   endx    = std::min((it->x + it->width + 15) / 16, mb_width);
+            int   endy    = std::min((it->y + it->height + 15) / 16, total_mbs_ / mb_width);
+            float qoffset = std::max(-1.0f, std::min(1.0f, it->qoffset)) * X264_QP_RANGE;
+            for (int y = starty; y < endy; y++) {
+                for (int x = startx; x < endx; x++) {
+                    quant_offsets_[y * mb_width + x] = qoffset;
+                }
+            }
+        }
+        return quant_offsets_.data();
+    }
+
+    int X264SliceEncoder::encode(uint64_t frameid, AVFrame *inframe) {
+        if (!encoder_opened_) {
+            return -1;
+        }
+        if (inframe == nullptr) {
+            return flush(frameid);
+        }
+
+        x264_picture_t pic;
+        x264_picture_init(&pic);
+        pic.img.i_csp   = csp_;
+        pic.img.i_plane = csp_ == X264_CSP_NV12 ? 2 : 3;
+        for (int i = 0; i < pic.img.i_plane; i++) {
+            pic.img.plane[i]    = inframe->data[i];
+            pic.img.i_stride[i] = inframe->linesize[i];
+        }
+        pic.i_pts              = inframe->pts != AV_NOPTS_VALUE ? inframe->pts : pts_;
+        pts_                   = pic.i_pts + 1;
+        pic.i_type             = inframe->pict_type == AV_PICTURE_TYPE_I ? X264_TYPE_IDR : X264_TYPE_AUTO;
+        pic.prop.quant_offsets = buildQuantOffsets();
+        pic.opaque             = this;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frameid_ = frameid;
+            next_mb_ = 0;
+            pending_.clear();
+            frame_buf_.clear();
+        }
+
+        x264_nal_t    *nals  = nullptr;
+        int            count = 0;
+        x264_picture_t pic_out;
+        if (x264_encoder_encode(encoder_, &nals, &count, &pic, &pic_out) < 0) {
+            LOG_CHN(ERROR, chn_) << "x264 encode failed";
+            return -1;
+        }
+        return output(frameid, nals, count, pic_out);
+    }
+
+    int X264SliceEncoder::output(uint64_t frameid, x264_nal_t *nals, int count, const x264_picture_t &pic_out) {
+        const uint8_t *data = nullptr;
+        size_t         size = 0;
+        if (slice_callback_) {
+            // 按slice回调时x264_encoder_encode不返回NAL，整帧用回调里收集的
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pending_.empty()) {
+                LOG_CHN(WARN, chn_) << "slices not contiguous, first mb " << pending_.begin()->first;
+                pending_.clear();
+            }
+            data = frame_buf_.data();
+            size = frame_buf_.size();
+        } else if (count > 0) {
+            // 一帧的NAL在x264的缓冲里是连续的
+            data = nals[0].p_payload;
+            for (int i = 0; i < count; i++) {
+                size += nals[i].i_payload;
+            }
+        }
+        if (callback_ == nullptr || size == 0) {
+            return 0;
+        }
+
+        AVPacket *pkt = av_packet_alloc();
+        if (pkt == nullptr || av_new_packet(pkt, (int)size) < 0) {
+            av_packet_free(&pkt);
+            return -1;
+        }
+        memcpy(pkt->data, data, size);
+        pkt->pts = pic_out.i_pts;
+        pkt->dts = pic_out.i_dts;
+        if (pic_out.b_keyframe) {
+            pkt->flags |= AV_PKT_FLAG_KEY;
+        }
+        if (latency_sei_) {
+            insertLatencySei(pkt, AV_CODEC_ID_H264);
+        }
+        callback_(frameid, pkt);
+        av_packet_free(&pkt);
+        return 0;
+    }
+
+    int X264SliceEncoder::flush(uint64_t frameid) {
+        if (!encoder_opened_) {
+            return 0;
+        }
+        // zerolatency没有延迟的帧，这里只是兜底
+        while (x264_encoder_delayed_frames(encoder_) > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                frameid_ = frameid;
+                next_mb_ = 0;
+                frame_buf_.clear();
+            }
+            x264_nal_t    *nals  = nullptr;
+            int            count = 0;
+            x264_picture_t pic_out;
+            if (x264_encoder_encode(encoder_, &nals, &count, nullptr, &pic_out) < 0) {
+                return -1;
+            }
+            output(frameid, nals, count, pic_out);
+        }
+        return 0;
+    }
+
+    int X264SliceEncoder::close() {
+        encoder_opened_ = false;
+        if (encoder_) {
+            x264_encoder_close(encoder_);
+            encoder_ = nullptr;
+        }
+        return 0;
+    }
+
+    bool X264SliceEncoder::isopend() {
+        return encoder_opened_;
+    }
+} // namespace Codec
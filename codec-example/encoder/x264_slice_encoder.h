@@ -0,0 +1,120 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <stdint.h>
+#include <x264.h>
+}
+#include "encoder.h"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 默认每帧的slice数
+#define X264_SLICE_COUNT 4
+
+/**
+ * @brief 编码器-直接调用x264，按slice输出
+ * libavcodec的libx264只能整帧出packet；这里用x264的nalu_process，每个slice编码完就回调，
+ * 网络可以在这一帧的其他slice还在编码时开始发送。
+ * 没有设置slice回调时和SwEncoder一样整帧回调EncodeCallback；设置了的话EncodeCallback可以为空，
+ * 不为空时整帧再回调一次。只支持H264、YUV420P/NV12输入，无B帧、无lookahead
+ */
+namespace Codec {
+    class X264SliceEncoder : public BasicEncoder {
+    public:
+        using Ptr = std::shared_ptr<X264SliceEncoder>;
+
+        // 一个NAL（Annex-B，带start code），SPS/PPS/SEI也从这里出来；
+        // last为这一帧的最后一个NAL。在x264的编码线程里调用，同一帧按码流顺序、不会并发
+        using SliceCallback =
+            std::function<void(uint64_t frameid, const uint8_t *data, int size, int nal_type, bool last)>;
+
+        explicit X264SliceEncoder(int chn)
+            : BasicEncoder(chn){};
+        virtual ~X264SliceEncoder() {
+            close();
+        };
+
+        virtual int open(AVCodecID codecID, AVPixelFormat inPixel, AVBufferRef *hw_frame_ctx, int width,
+                         int height, EncodeCallback callback);
+
+        virtual int encode(uint64_t frameid, AVFrame *inframe);
+        using BasicEncoder::encode;
+
+        virtual int flush(uint64_t frameid);
+
+        virtual int close();
+
+        virtual bool isopend();
+
+        // 以下在open之前设置
+        void setSliceCallback(SliceCallback callback) {
+            slice_callback_ = std::move(callback);
+        }
+
+        // slices：每帧的slice数，max_bytes不为0时按字节数切（比如网络MTU），优先于slices
+        void setSlices(int slices, int max_bytes = 0) {
+            slices_    = slices > 0 ? slices : 1;
+            max_bytes_ = max_bytes > 0 ? max_bytes : 0;
+        }
+
+        // 0为x264自动；多线程时按slice并行编码（sliced threads），x264把每帧的slice数定为线程数，
+        // slice的完成顺序不固定，这里按宏块顺序交出。单线程时slice顺序编码，首个slice出得最早
+        void setThreadCount(int threads) {
+            threads_ = threads > 0 ? threads : 0;
+        }
+
+        void setPreset(const std::string &preset) {
+            preset_ = preset;
+        }
+
+    private:
+        static void onNal(x264_t *h, x264_nal_t *nal, void *opaque);
+
+        // 按宏块顺序把已经连上的slice交给回调
+        void emitReady();
+
+        void emit(const std::vector<uint8_t> &nal, int nal_type, bool last);
+
+        // 通道的ROI和这一帧的提示转成x264的quant_offsets，没有ROI时返回nullptr
+        float *buildQuantOffsets();
+
+        int output(uint64_t frameid, x264_nal_t *nals, int count, const x264_picture_t &pic_out);
+
+    private:
+        x264_t        *encoder_        = nullptr;
+        bool           encoder_opened_ = false;
+        EncodeCallback callback_       = nullptr;
+        SliceCallback  slice_callback_ = nullptr;
+
+        std::string preset_    = "veryfast";
+        int         slices_    = X264_SLICE_COUNT;
+        int         max_bytes_ = 0;
+        int         threads_   = 0;
+        int         width_     = 0;
+        int         height_    = 0;
+        int         csp_       = X264_CSP_I420;
+        int         total_mbs_ = 0;
+        int64_t     pts_       = 0;
+
+        // 编完还没交出去的slice，覆盖的宏块到last_mb为止
+        struct Slice {
+            int                  nal_type = 0;
+            int                  last_mb  = 0;
+            std::vector<uint8_t> data;
+        };
+
+        // 当前帧的slice重排，nalu_process在x264的线程里调用
+        std::mutex           mutex_;
+        uint64_t             frameid_ = 0;
+        int                  next_mb_ = 0; // 下一个要交出去的slice的首个宏块
+        std::map<int, Slice> pending_;     // 首个宏块 -> 先编完的slice
+        std::vector<uint8_t> frame_buf_;   // 整帧回调用
+
+        std::vector<float> quant_offsets_; // ROI转成的每个宏块的QP偏移
+    };
+} // namespace Codec
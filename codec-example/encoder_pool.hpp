@@ -0,0 +1,208 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#include "common.hpp"
+#include "sw_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// 每种配置最少留多少个空闲的编码器，预热数比它多时按预热数
+#define ENCODER_POOL_MIN_IDLE 4
+
+/**
+ * @brief 按（编码、宽高、像素格式、profile）缓存已经打开的软件编码器
+ * avcodec_open2打开x264要几十毫秒，大量通道同时重连时集中打开会让CPU尖峰、每路出第一帧都变慢；
+ * 启动时按通道配置预先打开，通道断开时reset后放回，重连直接取走，取不到才现场打开
+ */
+namespace Codec {
+    struct EncoderKey {
+        AVCodecID     codec   = AV_CODEC_ID_H264;
+        int           width   = 0;
+        int           height  = 0;
+        AVPixelFormat pix_fmt = AV_PIX_FMT_YUV420P;
+        int           profile = FF_PROFILE_UNKNOWN;
+
+        bool operator<(const EncoderKey &other) const {
+            return std::tie(codec, width, height, pix_fmt, profile) <
+                   std::tie(other.codec, other.width, other.height, other.pix_fmt, other.profile);
+        }
+    };
+
+    class EncoderPool {
+    public:
+        using Ptr = std::shared_ptr<EncoderPool>;
+
+        // hits：取到了预先打开的，misses：现场打开，open_ms：所有打开的总耗时
+        struct Stats {
+            uint64_t hits     = 0;
+            uint64_t misses   = 0;
+            uint64_t reopened = 0; // 放回时reset失败，关掉重开
+            double   open_ms  = 0;
+        };
+
+        EncoderPool(){};
+        ~EncoderPool() {
+            clear();
+        };
+
+        // 启动时按通道配置预热，每种配置打开count个，多线程并行打开，返回打开成功的个数
+        int prewarm(const std::vector<std::pair<EncoderKey, int>> &mix) {
+            std::vector<EncoderKey> jobs;
+            for (auto &item : mix) {
+                for (int i = 0; i < item.second; i++) {
+                    jobs.push_back(item.first);
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                max_idle_[item.first] = std::max(max_idle_[item.first], std::max(item.second, ENCODER_POOL_MIN_IDLE));
+            }
+            if (jobs.empty()) {
+                return 0;
+            }
+
+            size_t                   next    = 0;
+            int                      success = 0;
+            std::mutex               job_mutex;
+            std::vector<std::thread> threads;
+            size_t                   workers = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t t = 0; t < std::min(workers, jobs.size()); t++) {
+                threads.emplace_back([&]() {
+                    while (true) {
+                        EncoderKey key;
+                        {
+                            std::lock_guard<std::mutex> lock(job_mutex);
+                            if (next >= jobs.size()) {
+                                return;
+                            }
+                            key = jobs[next++];
+                        }
+                        SwEncoder::Ptr encoder = open(key, 0);
+                        if (encoder == nullptr) {
+                            continue;
+                        }
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        idle_[key].push_back(encoder);
+                        success++;
+                    }
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            LOG(INFO) << "encoder pool prewarm " << success << "/" << jobs.size() << std::endl;
+            return success;
+        }
+
+        // 通道连上时取一个编码器，callback和通道号换成这个通道的
+        SwEncoder::Ptr acquire(const EncoderKey &key, int chn, BasicEncoder::EncodeCallback callback) {
+            SwEncoder::Ptr encoder;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto                        it = idle_.find(key);
+                if (it != idle_.end() && !it->second.empty()) {
+                    encoder = it->second.back();
+                    it->second.pop_back();
+                    stats_.hits++;
+                } else {
+                    stats_.misses++;
+                }
+            }
+            if (encoder == nullptr) {
+                encoder = open(key, chn);
+                if (encoder == nullptr) {
+                    return nullptr;
+                }
+            }
+            encoder->setChannel(chn);
+            encoder->setCallback(std::move(callback));
+            return encoder;
+        }
+
+        // 通道断开时放回，编码器reset后给下一个通道用；超过空闲上限的直接关掉
+        void release(const EncoderKey &key, SwEncoder::Ptr encoder) {
+            if (encoder == nullptr) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto                        it    = max_idle_.find(key);
+                int                         limit = it == max_idle_.end() ? ENCODER_POOL_MIN_IDLE : it->second;
+                if ((int)idle_[key].size() >= limit) {
+                    encoder->close();
+                    return;
+                }
+            }
+
+            if (encoder->reset() < 0) {
+                // 不支持flush的编码器关掉重开，重开的耗时不落在下一次连接上
+                encoder->close();
+                encoder = open(key, 0);
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.reopened++;
+                if (encoder == nullptr) {
+                    return;
+                }
+            }
+            encoder->setChannel(0);
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_[key].push_back(encoder);
+        }
+
+        void clear() {
+            std::map<EncoderKey, std::vector<SwEncoder::Ptr>> encoders;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                encoders.swap(idle_);
+            }
+            for (auto &item : encoders) {
+                for (auto &encoder : item.second) {
+                    encoder->close();
+                }
+            }
+        }
+
+        size_t idle(const EncoderKey &key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = idle_.find(key);
+            return it == idle_.end() ? 0 : it->second.size();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stats_;
+        }
+
+    private:
+        SwEncoder::Ptr open(const EncoderKey &key, int chn) {
+            auto start   = std::chrono::steady_clock::now();
+            auto encoder = std::make_shared<SwEncoder>(chn);
+            encoder->setProfile(key.profile);
+            // 预热时还没有通道，packet丢掉；acquire时换成通道的回调
+            auto drop = [](uint64_t, AVPacket *) {};
+            if (encoder->open(key.codec, key.pix_fmt, nullptr, key.width, key.height, drop) < 0) {
+                encoder->close();
+                return nullptr;
+            }
+            encoder->setCallback(nullptr);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.open_ms += ms;
+            return encoder;
+        }
+
+    private:
+        std::mutex                                        mutex_;
+        std::map<EncoderKey, std::vector<SwEncoder::Ptr>> idle_;
+        std::map<EncoderKey, int>                         max_idle_;
+        Stats                                             stats_;
+    };
+} // namespace Codec
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "common.hpp"
+#include "h264bs.hpp"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#define GOP_CACHE_MIN_BYTES (1 << 20)
+#define GOP_CACHE_MAX_BYTES (64 << 20)
+
+/**
+ * @brief 每个通道一个GOP缓存，新加入的消费者不用等下一个IDR
+ * 缓存每个id最新的参数集（H264的SPS/PPS，H265还有VPS）和最近一个随机接入点（IDR，H265为IRAP）以来的所有packet，数据连续存放在一块引用计数的内存里；
+ * 取出的packet用shared_ptr别名指向这块内存，任意多个消费者读取都不拷贝
+ */
+namespace Codec {
+    class GopCache {
+    public:
+        using Ptr = std::shared_ptr<GopCache>;
+
+        explicit GopCache(int chn, size_t max_bytes = GOP_CACHE_MAX_BYTES,
+                          H264_BS::CodecType codec = H264_BS::CODEC_H264)
+            : chn_(chn)
+            , max_bytes_(max_bytes)
+            , codec_(codec){};
+        ~GopCache(){};
+
+        // 直播源送来的每个packet（Annex-B），遇到IDR（H265为IRAP）时重新开始缓存
+        int push(const FGRecord::AVPacketSP &pkt) {
+            if (pkt == nullptr || pkt->data == nullptr || pkt->size == 0) {
+                return -1;
+            }
+            const uint8_t *data = pkt->data.get();
+
+            bool               idr = false;
+            std::set<ParamKey> in_packet; // 这个packet自己带的参数集
+            std::lock_guard<std::mutex> lock(mutex_);
+            H264_BS::MediaDetector::forEachNal(data, pkt->size, 0, [&](const unsigned char *nal, size_t size) {
+                int type = H264_BS::MediaDetector::getNalType(nal, codec_);
+                if (H264_BS::MediaDetector::isParamSet(type, codec_)) {
+                    // 解析不出id时按0处理
+                    int      id = H264_BS::MediaDetector::getParameterSetId(nal, size, codec_);
+                    ParamKey key(type, id < 0 ? 0 : id);
+                    save_param(params_[key], nal, size);
+                    in_packet.insert(key);
+                } else if (H264_BS::MediaDetector::isIrap(type, codec_)) {
+                    idr = true;
+                }
+                return true;
+            });
+
+            if (idr) {
+                size_t need = codec_ == H264_BS::CODEC_H265 ? 3 : 2;
+                if (param_types() < need) {
+                    LOG_CHN(WARN, chn_) << "idr without parameter sets, gop not cached" << std::endl;
+                    reset();
+                    return -1;
+                }
+                // 新的GOP换一块新内存，旧的还在被消费者引用时由shared_ptr保留
+                reset();
+                size_t params_bytes = 0;
+                for (auto &param : params_) {
+                    params_bytes += param.second.size();
+                }
+                size_t expect = last_gop_bytes_ * 2 + params_bytes + pkt->size;
+                reserve(expect < max_bytes_ ? expect : max_bytes_);
+                if (in_packet.size() < params_.size()) {
+                    // 缺了任何一个就把当前所有的参数集都补上，按(NAL类型, id)从小到大即VPS、SPS、PPS的顺序，
+                    // PPS解析时引用的SPS已经在前面；和packet里自带的重复没有关系
+                    for (auto &param : params_) {
+                        append(param.second.data(), param.second.size());
+                    }
+                }
+                caching_ = true;
+            } else if (!caching_) {
+                return 0;
+            }
+
+            size_t offset = entries_.empty() ? 0 : used_;
+            if (used_ + pkt->size > max_bytes_) {
+                // GOP太长，不再缓存，等下一个随机接入点
+                LOG_CHN(WARN, chn_) << "gop cache over " << max_bytes_ << " bytes, drop until next idr"
+                                    << std::endl;
+                reset();
+                return -1;
+            }
+            append(data, pkt->size);
+
+            Entry entry;
+            entry.offset    = offset;
+            entry.size      = used_ - offset;
+            entry.timestamp = pkt->timestamp;
+            entry.fps       = pkt->fps;
+            entries_.push_back(entry);
+            last_gop_bytes_ = used_ > last_gop_bytes_ ? used_ : last_gop_bytes_;
+            return 0;
+        }
+
+        /**
+         * @brief 新消费者取一份可以直接解码的数据：第一个packet为参数集+IDR，后面依次是IDR之后的packet
+         * 还没有收到IDR时返回空；H265从CRA开始时，紧跟的RASL帧解码器会自行丢弃
+         */
+        std::vector<FGRecord::AVPacketSP> snapshot() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<FGRecord::AVPacketSP> packets;
+            packets.reserve(entries_.size());
+            for (const Entry &entry : entries_) {
+                auto pkt       = std::make_shared<FGRecord::AVPacket>();
+                pkt->timestamp = entry.timestamp;
+                pkt->fps       = entry.fps;
+                pkt->size      = (uint32_t)entry.size;
+                // 别名构造：引用计数记在整块内存上，指针指向这一帧
+                pkt->data = std::shared_ptr<uint8_t>(block_, block_.get() + entry.offset);
+                packets.push_back(pkt);
+            }
+            return packets;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            reset();
+            params_.clear();
+        }
+
+        size_t frames() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return entries_.size();
+        }
+
+        size_t bytes() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return used_;
+        }
+
+    private:
+        struct Entry {
+            size_t   offset    = 0;
+            size_t   size      = 0;
+            uint64_t timestamp = 0;
+            uint32_t fps       = 0;
+        };
+
+        // 有几种参数集（H264的SPS/PPS，H265还有VPS）
+        size_t param_types() const {
+            std::set<int> types;
+            for (auto &param : params_) {
+                types.insert(param.first.first);
+            }
+            return types.size();
+        }
+
+        static void save_param(std::vector<uint8_t> &param, const unsigned char *nal, size_t size) {
+            static const uint8_t start_code[4] = {0, 0, 0, 1};
+            param.assign(start_code, start_code + 4);
+            param.insert(param.end(), nal, nal + size);
+        }
+
+        void reset() {
+            block_.reset();
+            capacity_ = 0;
+            used_     = 0;
+            caching_  = false;
+            entries_.clear();
+        }
+
+        void reserve(size_t size) {
+            size = size < GOP_CACHE_MIN_BYTES ? GOP_CACHE_MIN_BYTES : size;
+            if (size <= capacity_) {
+                return;
+            }
+            std::shared_ptr<uint8_t> block(new uint8_t[size], std::default_delete<uint8_t[]>());
+            if (used_) {
+                memcpy(block.get(), block_.get(), used_);
+            }
+            block_    = block;
+            capacity_ = size;
+        }
+
+        // [0, used_)的数据写入后不再修改，消费者可以不加锁读；容量不够时换更大的一块，
+        // 已经取走的snapshot继续引用旧的那块
+        void append(const uint8_t *data, size_t size) {
+            if (used_ + size > capacity_) {
+                size_t grow = capacity_ * 2;
+                reserve(grow > used_ + size ? grow : used_ + size);
+            }
+            memcpy(block_.get() + used_, data, size);
+            used_ += size;
+        }
+
+    private:
+        int                chn_       = -1;
+        size_t             max_bytes_ = GOP_CACHE_MAX_BYTES;
+        H264_BS::CodecType codec_     = H264_BS::CODEC_H264;
+
+        std::mutex mutex_;
+
+        // (NAL类型, 参数集id) -> 带起始码的参数集，每个id只保留最新的一个；
+        // 流里用了多个SPS/PPS时都要留着，slice可能引用其中任意一个
+        using ParamKey = std::pair<int, int>;
+        std::map<ParamKey, std::vector<uint8_t>> params_;
+
+        std::shared_ptr<uint8_t> block_;
+        size_t                   capacity_       = 0;
+        size_t                   used_           = 0;
+        size_t                   last_gop_bytes_ = 0;
+        bool                     caching_        = false;
+        std::vector<Entry>       entries_;
+    };
+} // namespace Codec
@@ -0,0 +1,105 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief 编码的感兴趣区域（ROI），转成AV_FRAME_DATA_REGIONS_OF_INTEREST挂在帧上，
+ * libx264（需要开着aq-mode，默认开）和支持ROI的硬件编码器按区域调整QP
+ * 区域重叠时排在前面的优先
+ */
+namespace Codec {
+    struct RoiRegion {
+        int   x       = 0;
+        int   y       = 0;
+        int   width   = 0;
+        int   height  = 0;
+        float qoffset = 0; // [-1, 1]，负数提高质量，正数降低质量（比如天空、时间戳）
+    };
+
+    // 裁到帧的范围内写进side data，没有有效区域时返回0，出错返回-1；
+    // qoffset为0的区域也保留，排在前面时可以从后面的大区域里挖掉一块
+    inline int attachRoiSideData(AVFrame *frame, const std::vector<RoiRegion> &regions) {
+        std::vector<AVRegionOfInterest> rois;
+        for (const RoiRegion &region : regions) {
+            AVRegionOfInterest roi;
+            roi.self_size = sizeof(AVRegionOfInterest);
+            roi.left      = region.x > 0 ? region.x : 0;
+            roi.top       = region.y > 0 ? region.y : 0;
+            roi.right     = region.x + region.width < frame->width ? region.x + region.width : frame->width;
+            roi.bottom    = region.y + region.height < frame->height ? region.y + region.height : frame->height;
+            if (roi.left >= roi.right || roi.top >= roi.bottom) {
+                continue;
+            }
+            float qoffset = region.qoffset < -1 ? -1 : (region.qoffset > 1 ? 1 : region.qoffset);
+            roi.qoffset   = AVRational{(int)std::lround(qoffset * 1000), 1000};
+            rois.push_back(roi);
+        }
+        if (rois.empty()) {
+            return 0;
+        }
+
+        AVFrameSideData *sd = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                                                     rois.size() * sizeof(AVRegionOfInterest));
+        if (sd == nullptr) {
+            return -1;
+        }
+        memcpy(sd->data, rois.data(), sd->size);
+        return (int)rois.size();
+    }
+
+    /**
+     * 按格子的掩码生成区域，mask为rows行cols列，非0的格子属于区域，每个格子cell_w x cell_h像素；
+     * 一行里连续的格子合成一个区域，和上一行左右边界相同的再往下合并
+     * 比如运动检测的结果：运动的格子给负的qoffset
+     */
+    inline void roiFromMask(const uint8_t *mask, int cols, int rows, int cell_w, int cell_h, float qoffset,
+                            std::vector<RoiRegion> &out) {
+        // 上一行结束的区域在out里的下标
+        std::vector<size_t> open, next;
+        for (int r = 0; r < rows; r++) {
+            next.clear();
+            const uint8_t *row = mask + (size_t)r * cols;
+            for (int c = 0; c < cols;) {
+                if (!row[c]) {
+                    c++;
+                    continue;
+                }
+                int start = c;
+                while (c < cols && row[c]) {
+                    c++;
+                }
+
+                RoiRegion region;
+                region.x       = start * cell_w;
+                region.y       = r * cell_h;
+                region.width   = (c - start) * cell_w;
+                region.height  = cell_h;
+                region.qoffset = qoffset;
+
+                bool merged = false;
+                for (size_t index : open) {
+                    RoiRegion &above = out[index];
+                    if (above.x == region.x && above.width == region.width &&
+                        above.y + above.height == region.y) {
+                        above.height += cell_h;
+                        next.push_back(index);
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged) {
+                    next.push_back(out.size());
+                    out.push_back(region);
+                }
+            }
+            open.swap(next);
+        }
+    }
+} // namespace Codec
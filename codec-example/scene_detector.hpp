@@ -0,0 +1,118 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+#include "pixfmt_kernels.hpp"
+
+#include <cstring>
+#include <vector>
+
+// 亮度每4行抽1行，块为64像素宽、4个抽样行（原图64x16）
+#define SCENE_ROW_STEP      4
+#define SCENE_BLOCK_WIDTH   64
+#define SCENE_BLOCK_ROWS    4
+// 块内每个样本的平均绝对差超过它就算画面变化，低于它的一般是传感器噪声
+#define SCENE_DIFF_THRESHOLD 4
+// 连续跳过的帧数上限，到了就正常编码一帧
+#define SCENE_MAX_SKIP 25
+
+/**
+ * @brief 编码前的静止画面检测
+ * 和上一个编码的帧比，不是和上一帧比：缓慢的变化（比如光线）会累积起来，最终超过阈值。
+ * 只保存抽样后的亮度行，任一块的差异超过阈值就返回变化，活动画面通常在前几块就提前结束；
+ * 只支持8bit的平面亮度（YUV/NV12/GRAY），其他格式总是返回变化
+ */
+namespace Codec {
+    enum StaticSkipMode {
+        SKIP_NONE = 0,
+        SKIP_DROP,  // 静止帧不送编码器，时间戳留下空缺，最长SCENE_MAX_SKIP帧
+        SKIP_REPEAT // 把上一个编码的帧再送一次，编码器几乎全是P_SKIP宏块，帧率不变
+    };
+
+    class SceneDetector {
+    public:
+        void setThreshold(int threshold) {
+            threshold_ = threshold > 0 ? threshold : 0;
+        }
+
+        static bool supported(AVPixelFormat format) {
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+            return desc && !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL)) &&
+                   desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].depth == 8;
+        }
+
+        // 和参考帧相比是否有变化；没有参考帧或者宽高变了算变化
+        bool changed(const AVFrame *frame) {
+            if (ref_.empty() || frame->width != width_ || frame->height != height_ ||
+                !supported((AVPixelFormat)frame->format)) {
+                return true;
+            }
+            const Utils::PixFmt::Kernels &k      = Utils::PixFmt::kernels();
+            int                           blocks = (width_ + SCENE_BLOCK_WIDTH - 1) / SCENE_BLOCK_WIDTH;
+            int                           rows   = sampled_rows();
+            sums_.assign(blocks, 0);
+            for (int r = 0; r < rows; r++) {
+                const uint8_t *cur = frame->data[0] + (size_t)r * SCENE_ROW_STEP * frame->linesize[0];
+                const uint8_t *ref = ref_.data() + (size_t)r * width_;
+                for (int b = 0; b < blocks; b++) {
+                    int x = b * SCENE_BLOCK_WIDTH;
+                    sums_[b] += k.sad(cur + x, ref + x, block_width(b));
+                }
+                // 一行块结束或者到了最后一行，检查这一行块
+                if ((r + 1) % SCENE_BLOCK_ROWS == 0 || r + 1 == rows) {
+                    int block_rows = r % SCENE_BLOCK_ROWS + 1;
+                    for (int b = 0; b < blocks; b++) {
+                        if (sums_[b] > (uint32_t)(threshold_ * block_width(b) * block_rows)) {
+                            return true;
+                        }
+                    }
+                    sums_.assign(blocks, 0);
+                }
+            }
+            return false;
+        }
+
+        // 编码了的帧作为新的参考
+        void update(const AVFrame *frame) {
+            if (!supported((AVPixelFormat)frame->format)) {
+                reset();
+                return;
+            }
+            width_   = frame->width;
+            height_  = frame->height;
+            int rows = sampled_rows();
+            ref_.resize((size_t)rows * width_);
+            for (int r = 0; r < rows; r++) {
+                memcpy(ref_.data() + (size_t)r * width_,
+                       frame->data[0] + (size_t)r * SCENE_ROW_STEP * frame->linesize[0], width_);
+            }
+        }
+
+        void reset() {
+            ref_.clear();
+            width_  = 0;
+            height_ = 0;
+        }
+
+    private:
+        int sampled_rows() const {
+            return (height_ + SCENE_ROW_STEP - 1) / SCENE_ROW_STEP;
+        }
+
+        // 最右边的块可能不满
+        int block_width(int b) const {
+            int rest = width_ - b * SCENE_BLOCK_WIDTH;
+            return rest < SCENE_BLOCK_WIDTH ? rest : SCENE_BLOCK_WIDTH;
+        }
+
+    private:
+        int threshold_ = SCENE_DIFF_THRESHOLD;
+        int width_     = 0;
+        int height_    = 0;
+
+        std::vector<uint8_t>  ref_;
+        std::vector<uint32_t> sums_;
+    };
+} // namespace Codec
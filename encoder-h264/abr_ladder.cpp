@@ -0,0 +1,208 @@
+#include "abr_ladder.h"
+
+#include <iostream>
+
+AbrLadder::~AbrLadder() {
+    finish();
+}
+
+int AbrLadder::add_rendition(int height, int64_t bit_rate, const std::string &filename) {
+    if (started_ || height <= 0 || filename.empty()) {
+        return -1;
+    }
+    Rendition rendition;
+    rendition.height   = height;
+    rendition.bit_rate = bit_rate;
+    rendition.filename = filename;
+    renditions_.push_back(rendition);
+    return 0;
+}
+
+void AbrLadder::set_frame_budget(int frames) {
+    frame_budget_ = frames > 0 ? frames : 1;
+}
+
+void AbrLadder::set_gop_size(int gop_size) {
+    gop_size_ = gop_size > 0 ? gop_size : 1;
+}
+
+void AbrLadder::set_framerate(AVRational framerate) {
+    framerate_ = framerate;
+}
+
+int AbrLadder::start(const AVFrame *frame) {
+    started_ = true;
+
+    int threads = (int)std::thread::hardware_concurrency();
+    int count   = 0;
+    for (const Rendition &rendition : renditions_) {
+        if (rendition.height > frame->height) {
+            std::cout << "skip rendition " << rendition.height << "p, source is only " << frame->height << "p"
+                      << std::endl;
+            continue;
+        }
+        count++;
+    }
+    if (count == 0) {
+        std::cout << "no rendition to encode" << std::endl;
+        return -1;
+    }
+
+    for (const Rendition &rendition : renditions_) {
+        if (rendition.height > frame->height) {
+            continue;
+        }
+        std::unique_ptr<Output> out(new Output(frame_budget_));
+        out->rendition = rendition;
+        // 按源的宽高比算宽度，4:2:0要求宽高都是偶数
+        out->width = (int)((int64_t)frame->width * rendition.height / frame->height + 1) & ~1;
+        out->rendition.height &= ~1;
+
+        if (out->width != frame->width || out->rendition.height != frame->height ||
+            frame->format != AV_PIX_FMT_YUV420P) {
+            out->sws = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format, out->width,
+                                      out->rendition.height, AV_PIX_FMT_YUV420P, SWS_BICUBIC, nullptr, nullptr,
+                                      nullptr);
+            out->scaled = av_frame_alloc();
+            if (out->sws == nullptr || out->scaled == nullptr) {
+                std::cout << "create scaler for " << rendition.height << "p failed" << std::endl;
+                return -1;
+            }
+            out->scaled->width  = out->width;
+            out->scaled->height = out->rendition.height;
+            out->scaled->format = AV_PIX_FMT_YUV420P;
+            if (av_frame_get_buffer(out->scaled, 0) < 0) {
+                return -1;
+            }
+        }
+
+        out->file = fopen(rendition.filename.c_str(), "wb");
+        if (out->file == nullptr) {
+            std::cout << "open out file failed: " << rendition.filename << std::endl;
+            return -1;
+        }
+        if (out->encoder.init_encoder() < 0) {
+            return -1;
+        }
+        out->encoder.set_framerate(framerate_);
+        out->encoder.set_bit_rate(rendition.bit_rate);
+        // 所有码率的编码器平分CPU，避免每个都按核数开线程
+        out->encoder.set_thread_count(threads > count ? threads / count : 1);
+        out->encoder.set_gop_size(gop_size_, true);
+
+        outputs_.push_back(std::move(out));
+    }
+    for (auto &out : outputs_) {
+        Output *output = out.get();
+        output->thread = std::thread([this, output]() { run(*output); });
+    }
+    return 0;
+}
+
+int AbrLadder::push(AVFrame *frame) {
+    if (!started_ && start(frame) < 0) {
+        finish();
+        return -1;
+    }
+    if (outputs_.empty()) {
+        return -1;
+    }
+
+    // 源帧按引用分给每个码率，读线程下一次读这个帧时会换新缓冲；
+    // 不可写的源（比如引用映射区）拷贝一份，读取返回后仍然有效
+    bool     borrowed = !av_frame_is_writable(frame);
+    AVFrame *src      = av_frame_clone(frame);
+    if (src == nullptr || (borrowed && av_frame_make_writable(src) < 0)) {
+        av_frame_free(&src);
+        return -1;
+    }
+    // 按源帧序号强制IDR，所有码率在同一帧上开始新的GOP
+    src->pict_type = src->pts % gop_size_ == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+    int ret = 0;
+    for (auto &out : outputs_) {
+        AVFrame *ref = av_frame_clone(src);
+        if (ref == nullptr || !out->queue.push(ref)) {
+            av_frame_free(&ref);
+            ret = -1;
+        }
+    }
+    av_frame_free(&src);
+    return ret;
+}
+
+void AbrLadder::run(Output &out) {
+    auto write_packet = [&](AVPacket *pkt) {
+        fwrite(pkt->data, 1, pkt->size, out.file);
+        out.bytes += pkt->size;
+    };
+
+    AVFrame *src = nullptr;
+    while (out.queue.pop(src)) {
+        // 出错后继续取走队列里的帧，不让push阻塞
+        if (out.ret == 0) {
+            AVFrame *in = src;
+            if (out.sws) {
+                if (renew_frame_buffer(out.scaled) < 0 || sws_scale_frame(out.sws, out.scaled, src) < 0) {
+                    out.ret = -1;
+                }
+                // pts、强制的pict_type和色彩信息
+                av_frame_copy_props(out.scaled, src);
+                in = out.scaled;
+            }
+            if (out.ret == 0 && out.encoder.encode(in, write_packet) < 0) {
+                out.ret = -1;
+            }
+            out.frames++;
+        }
+        av_frame_free(&src);
+    }
+    if (out.encoder.drain(write_packet) < 0) {
+        out.ret = -1;
+    }
+}
+
+int AbrLadder::finish() {
+    for (auto &out : outputs_) {
+        out->queue.close();
+    }
+    int ret = 0;
+    for (auto &out : outputs_) {
+        if (out->thread.joinable()) {
+            out->thread.join();
+            std::cout << out->rendition.height << "p " << out->width << "x" << out->rendition.height
+                      << ", frames: " << out->frames << ", bytes: " << out->bytes
+                      << (out->ret < 0 ? ", failed" : "") << std::endl;
+        }
+        ret = out->ret < 0 ? -1 : ret;
+    }
+    outputs_.clear();
+    return ret;
+}
+
+int AbrLadder::working(std::string infilename, std::string prefix, const InputFormat &format) {
+    if (renditions_.empty()) {
+        // 默认四档：1080p/720p/480p/240p
+        add_rendition(1080, 5000000, prefix + "_1080p.h264");
+        add_rendition(720, 3000000, prefix + "_720p.h264");
+        add_rendition(480, 1200000, prefix + "_480p.h264");
+        add_rendition(240, 400000, prefix + "_240p.h264");
+    }
+
+    // 只用它的读线程读取输入，每帧只读一次
+    FFMPEGEncoder source;
+    int           ret = 0;
+    source.read_yuv_file(infilename, format, [&](AVFrame *frame) {
+        if (!started_) {
+            // 帧率在read_yuv_file打开输入后才确定（Y4M取自文件头）
+            set_framerate(source.framerate());
+        }
+        if (ret == 0 && push(frame) < 0) {
+            ret = -1;
+        }
+    });
+    if (finish() < 0) {
+        ret = -1;
+    }
+    return ret;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include <stdio.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "h264encoder.h"
+
+// 默认最多同时存在的源帧数
+#define ABR_FRAME_BUDGET 8
+
+/**
+ * @brief 一路源生成多个码率：每帧源图像只读一次，按引用分给每个码率，
+ * 每个码率一个线程，各自用自己的SwsContext缩放后编码，互不等待；
+ * 所有码率GOP长度相同，按源帧序号在同一帧上强制IDR，切片时各码率可以对齐切换。
+ * 每个码率的输入队列长度为frame budget，最慢的码率积压满时push阻塞，源帧数量不会无限增长
+ */
+class AbrLadder {
+public:
+    struct Rendition {
+        int         height   = 0;
+        int64_t     bit_rate = 0;
+        std::string filename;
+    };
+
+    AbrLadder() {}
+    ~AbrLadder();
+
+    AbrLadder(const AbrLadder &) = delete;
+
+    // 第一帧之前设置；宽度按源的宽高比计算，高于源的码率不生成
+    int  add_rendition(int height, int64_t bit_rate, const std::string &filename);
+    void set_frame_budget(int frames);
+    void set_gop_size(int gop_size);
+    void set_framerate(AVRational framerate);
+
+    // 读取输入，生成所有码率，输出文件名为prefix_<高>p.h264
+    int working(std::string infilename, std::string prefix, const InputFormat &format);
+
+    // 送入一帧源图像，回调返回后源frame可以被调用者复用
+    int push(AVFrame *frame);
+
+    // 输入结束，冲刷所有编码器并等待线程结束
+    int finish();
+
+private:
+    struct Output {
+        Rendition     rendition;
+        int           width  = 0;
+        SwsContext   *sws    = nullptr; // 和源大小相同时为空，直接编码源帧
+        AVFrame      *scaled = nullptr;
+        FILE         *file   = nullptr;
+        FFMPEGEncoder encoder;
+        std::thread   thread;
+        int           ret    = 0;
+        uint64_t      frames = 0;
+        uint64_t      bytes  = 0;
+
+        Utils::BoundedQueue<AVFrame *> queue;
+
+        explicit Output(size_t capacity)
+            : queue(capacity) {}
+        ~Output() {
+            if (file) {
+                fclose(file);
+            }
+            sws_freeContext(sws);
+            av_frame_free(&scaled);
+        }
+    };
+
+    int  start(const AVFrame *frame);
+    void run(Output &out);
+
+private:
+    std::vector<Rendition>               renditions_;
+    std::vector<std::unique_ptr<Output>> outputs_;
+
+    int        frame_budget_ = ABR_FRAME_BUDGET;
+    int        gop_size_     = 60;
+    AVRational framerate_    = {25, 1};
+    bool       started_      = false;
+};
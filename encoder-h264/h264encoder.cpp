@@ -1,8 +1,18 @@
 #include "h264encoder.h"
 
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
 #include <stdio.h>
 
+#include <chrono>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
 
 static char  err_buf[1280] = {0};
 static char *av_get_err(int errnum) {
@@ -12,7 +22,9 @@ static char *av_get_err(int errnum) {
 
 FFMPEGEncoder::FFMPEGEncoder() {}
 
-FFMPEGEncoder::~FFMPEGEncoder() {}
+FFMPEGEncoder::~FFMPEGEncoder() {
+    deinit_encoder();
+}
 
 int FFMPEGEncoder::init_encoder() {
 
@@ -22,114 +34,301 @@ int FFMPEGEncoder::init_encoder() {
         return -1;
     }
 
-    pAVCodecContext_ = avcodec_alloc_context3(pAVCodec_);
-    if (pAVCodecContext_ == nullptr) {
-        std::cout << "avcodec_alloc_context3 failed" << std::endl;
+    pkt_ = av_packet_alloc();
+    if (pkt_ == nullptr) {
+        std::cout << "av_packet_alloc failed" << std::endl;
         return -1;
     }
 
-    pAVCodecContext_->time_base = AVRational{1, 25};
-    pAVCodecContext_->framerate = AVRational{25, 1};
-    pAVCodecContext_->gop_size  = 60; // 关键帧间隔？
-
-    // pAVCodecContext_->width   = 1920;
-    // pAVCodecContext_->height  = 1080;
-    // pAVCodecContext_->pix_fmt = AV_PIX_FMT_YUV420P;
+    framerate_ = AVRational{25, 1};
+    gop_size_  = 60; // 关键帧间隔
+    fixed_gop_ = false;
     return 0;
 }
 
 int FFMPEGEncoder::deinit_encoder() {
 
-    avcodec_free_context(&pAVCodecContext_);
+    close_session();
+    av_packet_free(&pkt_);
 
     return 0;
 }
 
-int FFMPEGEncoder::transcode(AVFrame *frame, std::function<void(AVPacket *pkt)> callback) {
-    pAVCodecContext_->width   = frame->width;
-    pAVCodecContext_->height  = frame->height;
-    pAVCodecContext_->pix_fmt = (AVPixelFormat)frame->format;
-    // pAVCodecContext_->pix_fmt = AV_PIX_FMT_YUV420P;
-    pAVCodecContext_->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+int FFMPEGEncoder::open_session(const AVFrame *frame) {
+    int           width   = frame->width;
+    int           height  = frame->height;
+    AVPixelFormat pix_fmt = (AVPixelFormat)frame->format;
 
-    int ret = avcodec_open2(pAVCodecContext_, pAVCodec_, NULL);
-    if (ret < 0) {
-        std::cout << "avcodec_open2 failed, " << av_get_err(ret) << std::endl;
+    pAVCodecContext_ = avcodec_alloc_context3(pAVCodec_);
+    if (pAVCodecContext_ == nullptr) {
+        std::cout << "avcodec_alloc_context3 failed" << std::endl;
         return -1;
     }
 
-    ret = avcodec_send_frame(pAVCodecContext_, frame);
+    pAVCodecContext_->time_base             = av_inv_q(framerate_);
+    pAVCodecContext_->framerate             = framerate_;
+    pAVCodecContext_->gop_size              = gop_size_;
+    pAVCodecContext_->width                 = width;
+    pAVCodecContext_->height                = height;
+    pAVCodecContext_->pix_fmt               = pix_fmt;
+    pAVCodecContext_->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+    // 色彩范围、色度位置、像素宽高比从第一帧取，写进SPS的VUI
+    pAVCodecContext_->sample_aspect_ratio    = frame->sample_aspect_ratio;
+    pAVCodecContext_->color_range            = frame->color_range;
+    pAVCodecContext_->chroma_sample_location = frame->chroma_location;
+    if (frame->interlaced_frame) {
+        // 隔行输入按场编码，场序由每帧的top_field_first决定
+        pAVCodecContext_->flags |= AV_CODEC_FLAG_INTERLACED_DCT | AV_CODEC_FLAG_INTERLACED_ME;
+        pAVCodecContext_->field_order = frame->top_field_first ? AV_FIELD_TT : AV_FIELD_BB;
+    }
+    pAVCodecContext_->bit_rate     = bit_rate_;
+    pAVCodecContext_->thread_count = thread_count_;
+
+    AVDictionary *opts = nullptr;
+    if (fixed_gop_) {
+        pAVCodecContext_->keyint_min = gop_size_;
+        // libx264的私有选项，其他编码器不认识时留在opts里忽略
+        av_dict_set(&opts, "sc_threshold", "0", 0);
+        av_dict_set(&opts, "forced-idr", "1", 0);
+    }
+
+    int ret = avcodec_open2(pAVCodecContext_, pAVCodec_, &opts);
+    av_dict_free(&opts);
     if (ret < 0) {
-        std::cout << "Error sending a frame for encoding, " << av_get_err(ret) << std::endl;
+        std::cout << "avcodec_open2 failed, " << av_get_err(ret) << std::endl;
+        avcodec_free_context(&pAVCodecContext_);
         return -1;
     }
+    std::cout << "encoder open, " << width << "x" << height << ", " << av_get_pix_fmt_name(pix_fmt)
+              << std::endl;
+    return 0;
+}
 
-    AVPacket *pkt = av_packet_alloc();
-
-    while (ret == 0) {
-
-        ret = avcodec_receive_packet(pAVCodecContext_, pkt);
+void FFMPEGEncoder::close_session() {
+    avcodec_free_context(&pAVCodecContext_);
+}
 
+int FFMPEGEncoder::receive_packets(PacketCallback &callback) {
+    while (true) {
+        int ret = avcodec_receive_packet(pAVCodecContext_, pkt_);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             return 0;
         } else if (ret < 0) {
-            fprintf(stderr, "Error encoding video frame\n");
+            std::cout << "Error encoding video frame, " << av_get_err(ret) << std::endl;
             return -1;
         }
-
-        if (ret == 0 && callback) {
-            // fwrite(pkt->data, 1, pkt->size, outFile);
-            callback(pkt);
+        if (callback) {
+            callback(pkt_);
         }
+        av_packet_unref(pkt_);
     }
+}
 
-    av_packet_free(&pkt);
+int FFMPEGEncoder::encode(AVFrame *frame, PacketCallback callback) {
+    if (pAVCodec_ == nullptr || pkt_ == nullptr) {
+        std::cout << "encoder not initialized" << std::endl;
+        return -1;
+    }
 
-    return 0;
+    if (pAVCodecContext_ &&
+        (pAVCodecContext_->width != frame->width || pAVCodecContext_->height != frame->height ||
+         pAVCodecContext_->pix_fmt != (AVPixelFormat)frame->format)) {
+        std::cout << "frame geometry changed, reopen encoder" << std::endl;
+        if (drain(callback) < 0) {
+            return -1;
+        }
+    }
+    if (pAVCodecContext_ == nullptr && open_session(frame) < 0) {
+        return -1;
+    }
+
+    int ret = avcodec_send_frame(pAVCodecContext_, frame);
+    if (ret == AVERROR(EAGAIN)) {
+        // 编码器输出没有取走，先取出再送
+        if (receive_packets(callback) < 0) {
+            return -1;
+        }
+        ret = avcodec_send_frame(pAVCodecContext_, frame);
+    }
+    if (ret < 0) {
+        std::cout << "Error sending a frame for encoding, " << av_get_err(ret) << std::endl;
+        return -1;
+    }
+    return receive_packets(callback);
 }
 
+int FFMPEGEncoder::drain(PacketCallback callback) {
+    if (pAVCodecContext_ == nullptr) {
+        return 0;
+    }
+    int ret = avcodec_send_frame(pAVCodecContext_, nullptr);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        std::cout << "Error flushing encoder, " << av_get_err(ret) << std::endl;
+        close_session();
+        return -1;
+    }
+    ret = receive_packets(callback);
+    close_session();
+    return ret;
+}
 
-int FFMPEGEncoder::read_yuv_file(std::string filename, int width, int height,
+int FFMPEGEncoder::read_yuv_file(std::string filename, const InputFormat &format,
                                  std::function<void(AVFrame *frame)> callback) {
 
-    FILE *pFile = fopen(filename.c_str(), "rb");
-    if (pFile == nullptr) {
-        std::cout << "open file[" << filename << "] failed" << std::endl;
+    YuvReader reader;
+    if (reader.open(filename, format) < 0) {
         return -1;
     }
-    std::cout << "start read file: " << filename << ", width: " << width << ", height: " << height;
+    const InputFormat &in = reader.format();
+    // Y4M文件头里的帧率优先，编码器在第一帧到来时才打开
+    framerate_ = in.framerate;
+
+    // 普通文件的裸YUV420P直接映射；Y4M每帧前有FRAME头，标准输入不能映射，都走读线程
+    // 上一次的映射：调用者已经drain过，帧引用都释放了
+    inmap_.close();
+    if (!reader.is_y4m() && !reader.is_stdin() && in.pix_fmt == AV_PIX_FMT_YUV420P &&
+        inmap_.open(filename, true) == 0) {
+        reader.close();
+        std::cout << "start read mapped file: " << filename << ", width: " << in.width
+                  << ", height: " << in.height << std::endl;
+        return read_mapped_yuv(in, callback);
+    }
 
-    AVFrame *frame = av_frame_alloc();
-    frame->width   = width;
-    frame->height  = height;
-    frame->format  = AV_PIX_FMT_YUV420P;
-    av_frame_get_buffer(frame, 0);
+    std::cout << "start read " << (reader.is_y4m() ? "y4m" : "yuv") << " file: " << filename
+              << ", width: " << in.width << ", height: " << in.height << ", "
+              << av_get_pix_fmt_name(in.pix_fmt) << ", fps: " << in.framerate.num << "/" << in.framerate.den
+              << (in.interlaced ? ", interlaced" : "") << std::endl;
+    return read_threaded_yuv(reader, callback);
+}
 
-    while (!feof(pFile)) {
-        int ret = av_frame_is_writable(frame);
-        if (ret < 0) {
-            av_frame_make_writable(frame);
+static double elapsed_ms(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int FFMPEGEncoder::read_threaded_yuv(YuvReader &yuv, std::function<void(AVFrame *frame)> callback) {
+    read_stats_ = ReadStats();
+
+    // free_frames里是可以写的空帧，filled_frames里是读好等编码的帧，帧在两个队列之间轮转
+    Utils::BoundedQueue<AVFrame *> free_frames(YUV_READ_RING_FRAMES);
+    Utils::BoundedQueue<AVFrame *> filled_frames(YUV_READ_RING_FRAMES);
+    std::vector<AVFrame *>         ring;
+    for (int i = 0; i < YUV_READ_RING_FRAMES; i++) {
+        AVFrame *frame = yuv.alloc_frame();
+        if (frame == nullptr) {
+            break;
+        }
+        ring.push_back(frame);
+        free_frames.push(frame);
+    }
+    if (free_frames.size() != YUV_READ_RING_FRAMES) {
+        std::cout << "alloc yuv frames failed" << std::endl;
+        for (AVFrame *frame : ring) {
+            av_frame_free(&frame);
+        }
+        return -1;
+    }
+
+    auto   start       = std::chrono::steady_clock::now();
+    double read_ms     = 0;
+    double reader_wait = 0;
+
+    std::thread reader([&]() {
+        int64_t  pts   = 0;
+        AVFrame *frame = nullptr;
+        while (true) {
+            auto t0 = std::chrono::steady_clock::now();
+            if (!free_frames.pop(frame)) {
+                break;
+            }
+            reader_wait += elapsed_ms(t0);
+
+            // 编码器可能还持有上一轮的引用（比如lookahead），这时换一块新缓冲
+            auto t1 = std::chrono::steady_clock::now();
+            bool ok = renew_frame_buffer(frame) >= 0 && yuv.read_frame(frame) == 0;
+            read_ms += elapsed_ms(t1);
+            if (!ok) {
+                // 文件结束（或读出错），不完整的最后一帧不送编码
+                break;
+            }
+
+            // 时间基为1/帧率，pts就是帧序号
+            frame->pts = pts++;
+            filled_frames.push(frame);
         }
+        filled_frames.close();
+    });
 
-        fread(frame->data[0], 1, width * height, pFile);     // y
-        fread(frame->data[1], 1, width * height / 4, pFile); // u
-        fread(frame->data[2], 1, width * height / 4, pFile); // v
+    AVFrame *frame = nullptr;
+    while (true) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!filled_frames.pop(frame)) {
+            break;
+        }
+        read_stats_.encode_wait += elapsed_ms(t0);
 
-        frame->pts += 1000 / (pAVCodecContext_->time_base.den / pAVCodecContext_->time_base.num);
+        auto t1 = std::chrono::steady_clock::now();
         if (callback) {
             callback(frame);
         }
+        read_stats_.encode_ms += elapsed_ms(t1);
+        read_stats_.frames++;
+        free_frames.push(frame);
     }
-    if (callback) {
-        callback(frame);
+    free_frames.close();
+    reader.join();
+
+    for (AVFrame *f : ring) {
+        av_frame_free(&f);
     }
 
-    av_frame_free(&frame);
-    fclose(pFile);
+    read_stats_.total_ms    = elapsed_ms(start);
+    read_stats_.read_ms     = read_ms;
+    read_stats_.reader_wait = reader_wait;
+    read_stats_.bytes       = read_stats_.frames * yuv.frame_size();
     return 0;
 }
 
-int FFMPEGEncoder::working(std::string infilename, std::string outfilename) {
+int FFMPEGEncoder::read_mapped_yuv(const InputFormat &format, std::function<void(AVFrame *frame)> callback) {
+    Utils::MappedFile &map = inmap_;
+    int size = av_image_get_buffer_size(format.pix_fmt, format.width, format.height, 1);
+    if (size <= 0) {
+        std::cout << "invalid input format, " << format.width << "x" << format.height << std::endl;
+        return -1;
+    }
+    const size_t frame_size = (size_t)size;
+    const size_t count      = map.size() / frame_size;
+
+    // 映射区不经过读线程，读盘（缺页）时间算在编码里
+    read_stats_ = ReadStats();
+    auto start  = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *src = map.data() + i * frame_size;
+
+        // 各平面在文件里是连续的、行间没有对齐，AVFrame直接指向映射区
+        AVFrame *frame = av_frame_alloc();
+        frame->width   = format.width;
+        frame->height  = format.height;
+        frame->format  = format.pix_fmt;
+        av_image_fill_arrays(frame->data, frame->linesize, src, format.pix_fmt, format.width, format.height, 1);
+        frame->buf[0] = map.ref(src, frame_size);
+        frame->pts    = (int64_t)i;
+
+        map.advance((i + 1) * frame_size);
+        auto t0 = std::chrono::steady_clock::now();
+        if (callback) {
+            callback(frame);
+        }
+        read_stats_.encode_ms += elapsed_ms(t0);
+        av_frame_free(&frame);
+    }
+    read_stats_.frames   = count;
+    read_stats_.bytes    = count * frame_size;
+    read_stats_.total_ms = elapsed_ms(start);
+    return 0;
+}
+
+int FFMPEGEncoder::working(std::string infilename, std::string outfilename, const InputFormat &format) {
 
     FILE *outFile = fopen(outfilename.c_str(), "wb");
     if (outFile == nullptr) {
@@ -138,12 +337,29 @@ int FFMPEGEncoder::working(std::string infilename, std::string outfilename) {
     }
     std::cout << "before read yuv" << std::endl;
 
-    read_yuv_file(infilename, 1920, 1080, [=](AVFrame *frame) {
-        int ret = this->transcode(frame, [=](AVPacket *pkt) { fwrite(pkt->data, 1, pkt->size, outFile); });
+    auto write_packet = [=](AVPacket *pkt) { fwrite(pkt->data, 1, pkt->size, outFile); };
+
+    read_yuv_file(infilename, format, [=](AVFrame *frame) {
+        int ret = this->encode(frame, write_packet);
         if (ret < 0) {
             exit(1);
         }
     });
+    // 取出编码器里缓存的帧（lookahead/B帧），否则文件末尾会少帧；之后编码器不再引用输入，可以解除映射
+    drain(write_packet);
+    inmap_.close();
+
+    const ReadStats &stats = read_stats_;
+    if (stats.total_ms > 0) {
+        double seconds = stats.total_ms / 1000;
+        std::cout << "frames: " << stats.frames << ", " << stats.frames / seconds << " fps, "
+                  << stats.bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+        std::cout << "read: " << stats.read_ms << " ms, encode: " << stats.encode_ms
+                  << " ms, encoder waiting input: " << stats.encode_wait
+                  << " ms, reader waiting frame: " << stats.reader_wait << " ms" << std::endl;
+        // 谁等得多，瓶颈就在另一边
+        std::cout << (stats.encode_wait > stats.reader_wait ? "read bound" : "encode bound") << std::endl;
+    }
 
     fclose(outFile);
 
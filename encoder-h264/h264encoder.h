@@ -7,10 +7,35 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include <cstdint>
 #include <functional>
+#include <string>
 
+#include "mapped_file.hpp"
+#include "yuv_reader.h"
+
+// fread路径上读线程和编码之间轮转的帧数
+#define YUV_READ_RING_FRAMES 4
+
+/**
+ * @brief 编码会话：init_encoder只设置参数，第一帧到来时按它的宽高/像素格式打开编码器，
+ * 之后一直复用同一个编码器上下文和AVPacket；输入结束时drain取出编码器里缓存的所有帧
+ */
 class FFMPEGEncoder {
 public:
+    using PacketCallback = std::function<void(AVPacket *pkt)>;
+
+    // read_yuv_file的吞吐统计，时间单位ms
+    struct ReadStats {
+        uint64_t frames      = 0;
+        uint64_t bytes       = 0;
+        double   total_ms    = 0;
+        double   read_ms     = 0; // 读线程fread耗时
+        double   encode_ms   = 0; // 回调（编码）耗时
+        double   reader_wait = 0; // 读线程等空闲帧：编码跟不上
+        double   encode_wait = 0; // 编码等读好的帧：读盘跟不上
+    };
+
     FFMPEGEncoder();
     ~FFMPEGEncoder();
 
@@ -19,15 +44,78 @@ public:
     int init_encoder();
     int deinit_encoder();
 
-    int working(std::string infilename, std::string outfilename);
+    int working(std::string infilename, std::string outfilename, const InputFormat &format);
+
+    // init_encoder之后设置，下一次打开会话时生效；bit_rate为0时用编码器默认的码率控制
+    void set_bit_rate(int64_t bit_rate) {
+        bit_rate_ = bit_rate;
+    }
+
+    void set_framerate(AVRational framerate) {
+        framerate_ = framerate;
+    }
+
+    void set_thread_count(int threads) {
+        thread_count_ = threads;
+    }
+
+    // 只在强制的位置（pict_type为I的帧）出IDR，关闭场景切换检测，多路输出的IDR才能对齐
+    void set_gop_size(int gop_size, bool fixed_gop) {
+        gop_size_  = gop_size;
+        fixed_gop_ = fixed_gop;
+    }
+
+    AVRational framerate() const {
+        return framerate_;
+    }
+
+    // 送入一帧，取出的packet在回调返回后即被复用；宽高或像素格式变化时先drain再重新打开
+    int encode(AVFrame *frame, PacketCallback callback);
 
-    int transcode(AVFrame *frame, std::function<void(AVPacket *pkt)> callback);
+    // 冲刷编码器，回调所有剩余的packet，之后会话关闭，下一帧会重新打开
+    int drain(PacketCallback callback);
 
-    // 从YUV文件中读取AVFrame，传入回调函数
-    int read_yuv_file(std::string filename, int width, int height,
+    /**
+     * @brief 从裸YUV/Y4M文件或标准输入（"-"）中读取AVFrame，传入回调函数
+     * 裸YUV按format的宽高/像素格式读，Y4M按文件头；编码帧率取自输入。
+     * 不能映射时由单独的读线程往YUV_READ_RING_FRAMES个预分配的帧里fread，读盘和编码重叠；
+     * 回调在调用线程里执行，返回后这一帧会被读线程复用。文件末尾不足一帧的数据丢弃。
+     * 映射读入时帧引用的映射区在下一次调用或者对象析构之前一直有效，drain可以放在返回之后
+     */
+    int read_yuv_file(std::string filename, const InputFormat &format,
                       std::function<void(AVFrame *frame)> callback);
 
+    const ReadStats &read_stats() const {
+        return read_stats_;
+    }
+
+private:
+    // 文件映射成功时帧数据直接引用映射区，不经过fread拷贝；平面的切分和YuvReader一致（奇数宽高的色度向上取整）
+    int read_mapped_yuv(const InputFormat &format, std::function<void(AVFrame *frame)> callback);
+
+    int read_threaded_yuv(YuvReader &yuv, std::function<void(AVFrame *frame)> callback);
+
+    // 按第一帧的宽高、像素格式、色彩信息和场序打开编码器
+    int  open_session(const AVFrame *frame);
+    void close_session();
+
+    // 取出所有已经编好的packet，返回0表示需要更多输入或已经结束
+    int receive_packets(PacketCallback &callback);
+
 private:
     const AVCodec  *pAVCodec_        = nullptr;
     AVCodecContext *pAVCodecContext_ = nullptr;
+    AVPacket       *pkt_             = nullptr;
+
+    AVRational framerate_    = {25, 1};
+    int        gop_size_     = 60;
+    bool       fixed_gop_    = false;
+    int64_t    bit_rate_     = 0;
+    int        thread_count_ = 0;
+
+    ReadStats read_stats_;
+
+    // 映射读入的帧引用这里，编码器（帧级多线程）或者下游队列在回调返回后可能还拿着引用，
+    // 所以映射一直保留到下一次read_yuv_file或者对象析构，不随read_yuv_file返回关闭
+    Utils::MappedFile inmap_;
 };
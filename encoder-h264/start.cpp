@@ -1,13 +1,82 @@
+#include "abr_ladder.h"
 #include "h264encoder.h"
 
-int main() {
+extern "C" {
+#include <libavutil/parseutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <cstdlib>
+#include <iostream>
+
+static void usage(const char *name) {
+    std::cout << name << " [input output] [-s WxH] [-pix_fmt fmt] [-r fps] [--abr [--budget N]]" << std::endl;
+    std::cout << "  input    raw yuv or y4m file, - for stdin" << std::endl;
+    std::cout << "  --abr    encode 1080p/720p/480p/240p, output is the file name prefix" << std::endl;
+    std::cout << "  --budget max source frames in flight in abr mode, default " << ABR_FRAME_BUDGET << std::endl;
+    std::cout << "  -s       raw yuv size, default 1920x1080, ignored for y4m" << std::endl;
+    std::cout << "  -pix_fmt raw yuv pixel format, default yuv420p, ignored for y4m" << std::endl;
+    std::cout << "  -r       raw yuv frame rate, default 25, ignored for y4m" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string input  = "../../movie/out2.yuv";
+    std::string output = "hello.h264";
+    InputFormat format;
+    format.width  = 1920;
+    format.height = 1080;
+
+    bool abr    = false;
+    int  budget = ABR_FRAME_BUDGET;
+
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-s" && i + 1 < argc) {
+            if (av_parse_video_size(&format.width, &format.height, argv[++i]) < 0) {
+                std::cout << "invalid size: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "-pix_fmt" && i + 1 < argc) {
+            format.pix_fmt = av_get_pix_fmt(argv[++i]);
+            if (format.pix_fmt == AV_PIX_FMT_NONE) {
+                std::cout << "invalid pixel format: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "-r" && i + 1 < argc) {
+            if (av_parse_video_rate(&format.framerate, argv[++i]) < 0) {
+                std::cout << "invalid frame rate: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "--abr") {
+            abr = true;
+        } else if (arg == "--budget" && i + 1 < argc) {
+            budget = atoi(argv[++i]);
+        } else if (files < 2 && (arg == "-" || arg[0] != '-')) {
+            (files++ == 0 ? input : output) = arg;
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (files == 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (abr) {
+        AbrLadder ladder;
+        ladder.set_frame_budget(budget);
+        return ladder.working(input, output, format);
+    }
+
     av_log_set_level(AV_LOG_TRACE);
     FFMPEGEncoder encoder;
 
     encoder.init_encoder();
-    encoder.working("../../movie/out2.yuv", "hello.h264");
+    encoder.working(input, output, format);
 
     encoder.deinit_encoder();
 
     return 0;
-}
\ No newline at end of file
+}
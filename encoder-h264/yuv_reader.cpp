@@ -0,0 +1,313 @@
+#include "yuv_reader.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <sstream>
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_MAX_HEADER 1024
+
+struct Y4mColorspace {
+    const char      *tag;
+    AVPixelFormat    pix_fmt;
+    AVChromaLocation chroma_loc;
+};
+
+// C参数，没有C参数时按420jpeg
+static const Y4mColorspace y4m_colorspaces[] = {
+    {"420jpeg", AV_PIX_FMT_YUV420P, AVCHROMA_LOC_CENTER},
+    {"420paldv", AV_PIX_FMT_YUV420P, AVCHROMA_LOC_TOPLEFT},
+    {"420mpeg2", AV_PIX_FMT_YUV420P, AVCHROMA_LOC_LEFT},
+    {"420", AV_PIX_FMT_YUV420P, AVCHROMA_LOC_CENTER},
+    {"411", AV_PIX_FMT_YUV411P, AVCHROMA_LOC_UNSPECIFIED},
+    {"422", AV_PIX_FMT_YUV422P, AVCHROMA_LOC_UNSPECIFIED},
+    {"444", AV_PIX_FMT_YUV444P, AVCHROMA_LOC_UNSPECIFIED},
+    {"444alpha", AV_PIX_FMT_YUVA444P, AVCHROMA_LOC_UNSPECIFIED},
+    {"mono", AV_PIX_FMT_GRAY8, AVCHROMA_LOC_UNSPECIFIED},
+    {"420p10", AV_PIX_FMT_YUV420P10LE, AVCHROMA_LOC_UNSPECIFIED},
+    {"422p10", AV_PIX_FMT_YUV422P10LE, AVCHROMA_LOC_UNSPECIFIED},
+    {"444p10", AV_PIX_FMT_YUV444P10LE, AVCHROMA_LOC_UNSPECIFIED},
+    {"mono10", AV_PIX_FMT_GRAY10LE, AVCHROMA_LOC_UNSPECIFIED},
+};
+
+// "num:den"，两个都要大于0（A0:0表示未知，由调用者处理）
+static bool parse_ratio(const std::string &value, AVRational &ratio) {
+    int num = 0, den = 0;
+    if (sscanf(value.c_str(), "%d:%d", &num, &den) != 2 || num < 0 || den < 0) {
+        return false;
+    }
+    ratio = AVRational{num, den};
+    return true;
+}
+
+int renew_frame_buffer(AVFrame *frame) {
+    if (av_frame_is_writable(frame)) {
+        return 0;
+    }
+    int width  = frame->width;
+    int height = frame->height;
+    int format = frame->format;
+    av_frame_unref(frame);
+    frame->width  = width;
+    frame->height = height;
+    frame->format = format;
+    return av_frame_get_buffer(frame, 0);
+}
+
+YuvReader::~YuvReader() {
+    close();
+}
+
+int YuvReader::open(const std::string &filename, const InputFormat &format) {
+    close();
+
+    if (filename == "-") {
+        file_ = stdin;
+    } else {
+        file_ = fopen(filename.c_str(), "rb");
+        if (file_ == nullptr) {
+            std::cout << "open file[" << filename << "] failed" << std::endl;
+            return -1;
+        }
+    }
+    // 管道一次读一帧，加大缓冲减少read系统调用
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    format_ = format;
+    y4m_    = false;
+
+    // 先读出magic长度的字节判断是不是Y4M，不是的话这些字节作为第一帧的开头
+    peek_.resize(strlen(Y4M_MAGIC));
+    peek_.resize(fread(peek_.data(), 1, peek_.size(), file_));
+    peek_pos_ = 0;
+    if (peek_.size() == strlen(Y4M_MAGIC) && memcmp(peek_.data(), Y4M_MAGIC, peek_.size()) == 0) {
+        peek_.clear();
+        std::string header;
+        if (!read_line(header) || parse_y4m_header(header) < 0) {
+            std::cout << "invalid y4m header: " << header << std::endl;
+            close();
+            return -1;
+        }
+        y4m_ = true;
+    }
+
+    if (setup_planes() < 0) {
+        close();
+        return -1;
+    }
+    frame_interlaced_ = format_.interlaced;
+    frame_tff_        = format_.top_field_first;
+    return 0;
+}
+
+void YuvReader::close() {
+    if (file_ && file_ != stdin) {
+        fclose(file_);
+    }
+    file_     = nullptr;
+    peek_pos_ = 0;
+    peek_.clear();
+}
+
+int YuvReader::setup_planes() {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format_.pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) || format_.width <= 0 ||
+        format_.height <= 0) {
+        std::cout << "invalid input format, " << format_.width << "x" << format_.height << std::endl;
+        return -1;
+    }
+    if (av_image_fill_linesizes(row_bytes_, format_.pix_fmt, format_.width) < 0) {
+        return -1;
+    }
+
+    planes_     = av_pix_fmt_count_planes(format_.pix_fmt);
+    frame_size_ = 0;
+    for (int i = 0; i < planes_; i++) {
+        // 第二、三个平面是色度，alpha平面和亮度一样高
+        plane_rows_[i] = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(format_.height, desc->log2_chroma_h) : format_.height;
+        frame_size_ += (size_t)row_bytes_[i] * plane_rows_[i];
+    }
+    return 0;
+}
+
+size_t YuvReader::read(uint8_t *dst, size_t size) {
+    size_t done = 0;
+    if (peek_pos_ < peek_.size()) {
+        done = peek_.size() - peek_pos_ < size ? peek_.size() - peek_pos_ : size;
+        memcpy(dst, peek_.data() + peek_pos_, done);
+        peek_pos_ += done;
+    }
+    if (done < size) {
+        done += fread(dst + done, 1, size - done, file_);
+    }
+    return done;
+}
+
+bool YuvReader::read_line(std::string &line) {
+    line.clear();
+    int c = 0;
+    while ((c = fgetc(file_)) != EOF) {
+        if (c == '\n') {
+            return true;
+        }
+        if (line.size() >= Y4M_MAX_HEADER) {
+            return false;
+        }
+        line.push_back((char)c);
+    }
+    return false;
+}
+
+int YuvReader::parse_y4m_header(const std::string &line) {
+    // 默认420jpeg、逐行；帧率和像素宽高比没给时沿用调用者的设置
+    format_.pix_fmt         = AV_PIX_FMT_YUV420P;
+    format_.chroma_loc      = AVCHROMA_LOC_CENTER;
+    format_.interlaced      = false;
+    format_.top_field_first = false;
+    format_.width           = 0;
+    format_.height          = 0;
+
+    std::istringstream tokens(line);
+    std::string        token;
+    while (tokens >> token) {
+        std::string value = token.substr(1);
+        switch (token[0]) {
+        case 'W':
+            format_.width = atoi(value.c_str());
+            break;
+        case 'H':
+            format_.height = atoi(value.c_str());
+            break;
+        case 'F': {
+            AVRational fps;
+            if (!parse_ratio(value, fps) || fps.num == 0 || fps.den == 0) {
+                return -1;
+            }
+            format_.framerate = fps;
+            break;
+        }
+        case 'A': {
+            AVRational sar;
+            if (parse_ratio(value, sar) && sar.num > 0 && sar.den > 0) {
+                format_.sample_aspect = sar;
+            }
+            break;
+        }
+        case 'I':
+            // m为逐帧不同，按每帧FRAME头的I参数，没有时当逐行
+            format_.interlaced      = value == "t" || value == "b";
+            format_.top_field_first = value == "t";
+            break;
+        case 'C': {
+            bool found = false;
+            for (const Y4mColorspace &cs : y4m_colorspaces) {
+                if (value == cs.tag) {
+                    format_.pix_fmt    = cs.pix_fmt;
+                    format_.chroma_loc = cs.chroma_loc;
+                    found              = true;
+                    break;
+                }
+            }
+            if (!found) {
+                std::cout << "unsupported y4m colorspace: " << value << std::endl;
+                return -1;
+            }
+            break;
+        }
+        case 'X':
+            if (value == "COLORRANGE=FULL") {
+                format_.color_range = AVCOL_RANGE_JPEG;
+            } else if (value == "COLORRANGE=LIMITED") {
+                format_.color_range = AVCOL_RANGE_MPEG;
+            }
+            break;
+        default:
+            // 不认识的参数按规范忽略
+            break;
+        }
+    }
+    return format_.width > 0 && format_.height > 0 ? 0 : -1;
+}
+
+int YuvReader::parse_frame_header(const std::string &line) {
+    if (line.compare(0, 5, "FRAME") != 0) {
+        std::cout << "invalid y4m frame header: " << line.substr(0, 32) << std::endl;
+        return -1;
+    }
+    frame_interlaced_ = format_.interlaced;
+    frame_tff_        = format_.top_field_first;
+
+    std::istringstream tokens(line.substr(5));
+    std::string        token;
+    while (tokens >> token) {
+        // Ixyz：x为场序，t/T顶场先，b/B底场先，其他（p、1、2、3）当逐行
+        if (token.size() >= 2 && token[0] == 'I') {
+            char order        = token[1];
+            frame_interlaced_ = order == 't' || order == 'T' || order == 'b' || order == 'B';
+            frame_tff_        = order == 't' || order == 'T';
+        }
+    }
+    return 0;
+}
+
+AVFrame *YuvReader::alloc_frame() const {
+    AVFrame *frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+    frame->width  = format_.width;
+    frame->height = format_.height;
+    frame->format = format_.pix_fmt;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+int YuvReader::read_frame(AVFrame *frame) {
+    if (file_ == nullptr) {
+        return AVERROR_EOF;
+    }
+    if (y4m_) {
+        std::string header;
+        if (!read_line(header)) {
+            return AVERROR_EOF;
+        }
+        if (parse_frame_header(header) < 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < planes_; i++) {
+        uint8_t *dst = frame->data[i];
+        size_t   row = (size_t)row_bytes_[i];
+        // linesize和一行的字节数相同时一次读完整个平面
+        if ((size_t)frame->linesize[i] == row) {
+            size_t size = row * plane_rows_[i];
+            if (read(dst, size) != size) {
+                return AVERROR_EOF;
+            }
+            continue;
+        }
+        for (int y = 0; y < plane_rows_[i]; y++) {
+            if (read(dst + (size_t)y * frame->linesize[i], row) != row) {
+                return AVERROR_EOF;
+            }
+        }
+    }
+
+    frame->sample_aspect_ratio = format_.sample_aspect;
+    frame->color_range         = format_.color_range;
+    frame->chroma_location     = format_.chroma_loc;
+    frame->interlaced_frame    = frame_interlaced_;
+    frame->top_field_first     = frame_tff_;
+    return 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/rational.h>
+}
+
+#include <stdio.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 输入图像的格式，裸YUV时由命令行给出，Y4M时由文件头覆盖
+struct InputFormat {
+    int              width           = 0;
+    int              height          = 0;
+    AVPixelFormat    pix_fmt         = AV_PIX_FMT_YUV420P;
+    AVRational       framerate       = {25, 1};
+    AVRational       sample_aspect   = {0, 1};
+    AVColorRange     color_range     = AVCOL_RANGE_UNSPECIFIED;
+    AVChromaLocation chroma_loc      = AVCHROMA_LOC_UNSPECIFIED;
+    bool             interlaced      = false; // Y4M为Im时每帧的FRAME头可以改变
+    bool             top_field_first = false;
+};
+
+/**
+ * @brief 帧的缓冲还被别人（编码器、其他线程）引用时换一块新的；和av_frame_make_writable不同，
+ * 不拷贝旧内容，给接下来整帧覆盖写的场合用
+ */
+int renew_frame_buffer(AVFrame *frame);
+
+/**
+ * @brief 顺序读取裸YUV或Y4M，文件名为"-"时读标准输入，可以直接接采集进程的管道
+ * 以"YUV4MPEG2 "开头的输入按Y4M解析文件头和每帧的FRAME头，否则按给定的宽高/像素格式读裸数据；
+ * 只顺序读，不seek，管道和普通文件一样处理
+ */
+class YuvReader {
+public:
+    YuvReader() {}
+    ~YuvReader();
+
+    YuvReader(const YuvReader &) = delete;
+
+    int  open(const std::string &filename, const InputFormat &format);
+    void close();
+
+    // 读一帧到已经分配好的frame里，读到完整的一帧返回0，输入结束（包括末尾不完整的帧）返回AVERROR_EOF
+    int read_frame(AVFrame *frame);
+
+    // 按format()分配一帧
+    AVFrame *alloc_frame() const;
+
+    const InputFormat &format() const {
+        return format_;
+    }
+
+    bool is_y4m() const {
+        return y4m_;
+    }
+
+    bool is_stdin() const {
+        return file_ == stdin;
+    }
+
+    // 一帧图像数据的字节数（不含Y4M的FRAME头）
+    size_t frame_size() const {
+        return frame_size_;
+    }
+
+private:
+    size_t read(uint8_t *dst, size_t size);
+    bool   read_line(std::string &line);
+    int    parse_y4m_header(const std::string &line);
+    int    parse_frame_header(const std::string &line);
+    int    setup_planes();
+
+private:
+    FILE       *file_ = nullptr;
+    InputFormat format_;
+    bool        y4m_  = false;
+
+    // 判断Y4M时先读出来的字节，之后的读取先从这里取
+    std::vector<uint8_t> peek_;
+    size_t               peek_pos_ = 0;
+
+    int    planes_        = 0;
+    int    row_bytes_[4]  = {0}; // 每个平面一行的字节数
+    int    plane_rows_[4] = {0};
+    size_t frame_size_    = 0;
+
+    // 当前帧的场序，Y4M的FRAME头里可以单独指定
+    bool frame_interlaced_ = false;
+    bool frame_tff_        = false;
+};
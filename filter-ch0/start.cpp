@@ -44,6 +44,8 @@ extern "C" {
 #include <functional>
 #include <iostream>
 
+#include "image_exporter.hpp"
+
 // const char *filter_descr = "scale=200:300,transpose=cclock";
 const char *filter_descr = "scale=960:720";
 /* other way:
@@ -65,84 +67,9 @@ static char *av_get_err(int errnum) {
     return errStr;
 }
 
-namespace Encodec {
-    // encoder
-    const AVCodec  *pEncodec_       = nullptr;
-    AVCodecContext *pEncodec_ctx_   = nullptr;
-    bool            encoder_opened_ = false;
-
-    using EncodeCallback = std::function<void(unsigned int frameid, AVPacket *outpkt)>;
-
-    int open_encoder(AVCodecID codecID, AVPixelFormat inPixel, int width, int height) {
-        pEncodec_ = avcodec_find_encoder(codecID);
-        if (pEncodec_ == nullptr) {
-            std::cout << "find encoder failed, " << codecID << std::endl;
-            return -1;
-        }
-
-        pEncodec_ctx_ = avcodec_alloc_context3(pEncodec_);
-        if (pEncodec_ctx_ == nullptr) {
-            std::cout << "encoder alloc context failed, " << codecID << std::endl;
-            return -1;
-        }
-
-        pEncodec_ctx_->pix_fmt               = inPixel;
-        pEncodec_ctx_->width                 = width;
-        pEncodec_ctx_->height                = height;
-        pEncodec_ctx_->time_base             = AVRational{1, 25}; // TODO
-        pEncodec_ctx_->framerate             = AVRational{25, 1};
-        pEncodec_ctx_->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
-        pEncodec_ctx_->gop_size              = 50;
-
-        int ret = avcodec_open2(pEncodec_ctx_, pEncodec_, NULL);
-        if (ret < 0) {
-            av_strerror(ret, errStr, sizeof(errStr));
-            std::cout << "encoder open failed, " << errStr << std::endl;
-            return -1;
-        }
-        encoder_opened_ = true;
-        std::cout << "encoder init done." << std::endl;
-        return 0;
-    }
-
-    int close_encoder() {
-        encoder_opened_ = false;
-        if (pEncodec_ctx_) {
-            avcodec_close(pEncodec_ctx_);
-            avcodec_free_context(&pEncodec_ctx_);
-        }
-        return 0;
-    }
-
-    int do_encode(unsigned int frameid, AVFrame *inframe, EncodeCallback callback) {
-        int ret = avcodec_send_frame(pEncodec_ctx_, inframe);
-        if (ret < 0) {
-            av_strerror(ret, errStr, sizeof(errStr));
-            std::cout << "encoder send frame failed, " << errStr << std::endl;
-            return -1;
-        }
-
-        AVPacket *pkt = av_packet_alloc();
-
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(pEncodec_ctx_, pkt);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                av_strerror(ret, errStr, sizeof(errStr));
-                std::cout << "encoder receive packet failed, " << errStr << std::endl;
-                break;
-            }
-
-            if (callback) {
-                callback(frameid, pkt);
-            }
-        }
-
-        av_packet_free(&pkt);
-        return 0;
-    }
-} // namespace Encodec
+// MJPEG每帧独立编码，交给导出线程池，按解码顺序拼接写到hello.mjpeg
+static Utils::ImageExporter exporter;
+static bool                 exporter_opened = false;
 
 static int open_input_file(const char *filename) {
     const AVCodec *dec;
@@ -263,25 +190,15 @@ end:
 
 static void display_frame(AVFrame *frame, AVRational time_base) {
     {
-        static int64_t countPts=0;
-        if (!Encodec::encoder_opened_) {
-            Encodec::open_encoder(AV_CODEC_ID_MJPEG, (AVPixelFormat)frame->format, frame->width,
-                                  frame->height);
+        if (!exporter_opened) {
+            Utils::ImageExporter::Options options;
+            options.codec   = AV_CODEC_ID_MJPEG;
+            options.output  = "hello.mjpeg";
+            exporter_opened = exporter.open(options) == 0;
         }
 
-        if (Encodec::encoder_opened_) {
-            // std::cout << "pts: " << frame->pts << std::endl;
-            frame->pts = ++countPts;
-
-            Encodec::do_encode(1, frame, [](int frameid, AVPacket *outpkt) {
-                FILE *pOutFile = fopen("hello.mjpeg", "a+");
-                if (pOutFile == nullptr) {
-                    std::cout << "out file open failed" << std::endl;
-                    return;
-                }
-                fwrite(outpkt->data, 1, outpkt->size, pOutFile);
-                fclose(pOutFile);
-            });
+        if (exporter_opened) {
+            exporter.write(frame);
         }
     }
     // int      x, y;
@@ -391,8 +308,8 @@ end:
     av_frame_free(&filt_frame);
     av_packet_free(&packet);
 
-    if (Encodec::encoder_opened_) {
-        Encodec::close_encoder();
+    if (exporter_opened) {
+        exporter.close();
     }
 
     if (ret < 0 && ret != AVERROR_EOF) {
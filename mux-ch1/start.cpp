@@ -1,21 +1,68 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/parseutils.h>
 }
 
+#include "h264bs.hpp"
+#include "nal_framing.hpp"
+
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 
 static char errStr[1024] = {0};
 
+// 把一段数据（Annex-B或长度前缀）里的SPS换成改写了VUI timing的版本，没有SPS时返回false
+static bool rewrite_sps(const uint8_t *data, size_t size, int length_size, AVRational fps,
+                        std::vector<uint8_t> &out) {
+    bool changed = false;
+    out.clear();
+    H264_BS::MediaDetector::forEachNal(data, size, length_size, [&](const unsigned char *nal, size_t nal_size) {
+        std::vector<uint8_t> sps;
+        if (H264_BS::MediaDetector::getNalType(nal) == 7 &&
+            H264_BS::MediaDetector::rewriteSpsTiming(nal, nal_size, fps.num, fps.den, sps)) {
+            nal      = sps.data();
+            nal_size = sps.size();
+            changed  = true;
+        }
+        if (length_size == 0) {
+            static const uint8_t start_code[4] = {0, 0, 0, 1};
+            out.insert(out.end(), start_code, start_code + 4);
+        } else {
+            for (int i = length_size - 1; i >= 0; i--) {
+                out.push_back((uint8_t)(nal_size >> (8 * i)));
+            }
+        }
+        out.insert(out.end(), nal, nal + nal_size);
+        return true;
+    });
+    return changed;
+}
+
+static uint8_t *alloc_padded(const std::vector<uint8_t> &data) {
+    uint8_t *buf = (uint8_t *)av_mallocz(data.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (buf) {
+        memcpy(buf, data.data(), data.size());
+    }
+    return buf;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        std::cout << "should: " << argv[0] << " inputfile outputfile" << std::endl;
+        std::cout << "should: " << argv[0] << " inputfile outputfile [fps]" << std::endl;
+        std::cout << "  fps: frame rate of raw h264 input, e.g. 25 or 30000/1001" << std::endl;
         return -1;
     }
 
     std::string infile(argv[1]);
     std::string outfile(argv[2]);
+    AVRational  userFps = {0, 1};
+    if (argc > 3 && (av_parse_video_rate(&userFps, argv[3]) < 0 || userFps.num <= 0)) {
+        std::cout << "invalid fps: " << argv[3] << std::endl;
+        return -1;
+    }
 
     av_log_set_level(AV_LOG_DEBUG);
 
@@ -51,7 +98,8 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    ret = avcodec_parameters_copy(outStream_->codecpar, pFormatCtx_->streams[videoindex]->codecpar);
+    AVStream *inStream_ = pFormatCtx_->streams[videoindex];
+    ret                 = avcodec_parameters_copy(outStream_->codecpar, inStream_->codecpar);
     // avcodec_parameters_from_context(
     // avcodec_parameters_from_context(outStream_->codecpar, );
     if (ret < 0) {
@@ -59,6 +107,60 @@ int main(int argc, char *argv[]) {
         std::cout << "parameter copy failed, " << errStr << std::endl;
         return -1;
     }
+    outStream_->codecpar->codec_tag = 0;
+
+    /**
+     * H264裸流没有时间戳，SPS里也常常没有timing_info，封装后帧率不对。
+     * 帧率取命令行参数，其次是SPS的VUI，再其次是探测到的帧率；必要时改写SPS的VUI，
+     * 时间戳按帧率和POC推算的显示顺序生成，不需要解码再编码
+     */
+    bool                        rawH264    = strcmp(pFormatCtx_->iformat->name, "h264") == 0;
+    bool                        rewriteVui = false;
+    AVRational                  fps        = {25, 1};
+    H264_BS::TimestampGenerator tsGen;
+    if (rawH264) {
+        AVCodecParameters *par = inStream_->codecpar;
+        H264_BS::MediaDetector::forEachNal(par->extradata, par->extradata_size, 0,
+                                           [&](const unsigned char *nal, size_t size) {
+                                               if (H264_BS::MediaDetector::getNalType(nal) == 7) {
+                                                   tsGen.setSps(nal, size);
+                                               }
+                                               return true;
+                                           });
+        const H264_BS::SpsInfo &sps = tsGen.sps();
+        if (userFps.num > 0) {
+            fps = userFps;
+        } else if (sps.timing_info_present && sps.num_units_in_tick && sps.time_scale) {
+            av_reduce(&fps.num, &fps.den, sps.time_scale, 2 * (int64_t)sps.num_units_in_tick, INT32_MAX);
+        } else if (inStream_->r_frame_rate.num > 0 && inStream_->r_frame_rate.den > 0) {
+            fps = inStream_->r_frame_rate;
+        }
+        rewriteVui = userFps.num > 0 || !sps.timing_info_present;
+
+        std::vector<uint8_t> extradata;
+        if (rewriteVui && rewrite_sps(par->extradata, par->extradata_size, 0, fps, extradata)) {
+            uint8_t *buf = alloc_padded(extradata);
+            if (buf == nullptr) {
+                return -1;
+            }
+            av_freep(&par->extradata);
+            par->extradata      = buf;
+            par->extradata_size = (int)extradata.size();
+        }
+        outStream_->time_base      = av_inv_q(fps);
+        outStream_->avg_frame_rate = fps;
+        std::cout << "raw h264, fps " << fps.num << "/" << fps.den << ", reorder delay " << tsGen.delay()
+                  << (rewriteVui ? ", rewrite sps vui" : "") << std::endl;
+    }
+
+    // mp4这类带全局头的封装要求长度前缀+avcC，ts/裸流要求start code，不用h264_mp4toannexb等BSF
+    Utils::NalFramer framer;
+    bool             outAvcc = pFormatOutCtx_->oformat->flags & AVFMT_GLOBALHEADER;
+    if (inStream_->codecpar->codec_id == AV_CODEC_ID_H264 &&
+        framer.init_remux(inStream_->codecpar, outStream_->codecpar, outAvcc) < 0) {
+        std::cout << "no sps/pps in input extradata, can't build avcC" << std::endl;
+        return -1;
+    }
 
     ret = avio_open(&pFormatOutCtx_->pb, outfile.c_str(), AVIO_FLAG_WRITE);
     if (ret < 0) {
@@ -74,7 +176,8 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    uint64_t pktCount = 0;
+    uint64_t             pktCount = 0;
+    std::vector<uint8_t> rewritten;
 
     while (ret >= 0) {
         AVPacket *readPkt = av_packet_alloc();
@@ -88,16 +191,49 @@ int main(int argc, char *argv[]) {
             break;
         }
         if (readPkt->stream_index == videoindex) {
+            AVRational inTimebase  = inStream_->time_base;
+            AVRational outTimebase = outStream_->time_base;
 
-            // 输入为mp4或这rtsp流时正常，输入为H264裸文件时，时间戳总是不对
-            readPkt->pts = av_rescale_q_rnd(readPkt->pts, pFormatCtx_->streams[videoindex]->time_base,
-                                            pFormatOutCtx_->streams[readPkt->stream_index]->time_base,
-                                            AV_ROUND_PASS_MINMAX);
+            if (rewriteVui && rewrite_sps(readPkt->data, readPkt->size, 0, fps, rewritten)) {
+                AVBufferRef *buf = av_buffer_alloc(rewritten.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+                if (buf) {
+                    memcpy(buf->data, rewritten.data(), rewritten.size());
+                    memset(buf->data + rewritten.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+                    av_buffer_unref(&readPkt->buf);
+                    readPkt->buf  = buf;
+                    readPkt->data = buf->data;
+                    readPkt->size = (int)rewritten.size();
+                }
+            }
+
+            int64_t framePts = 0, frameDts = 0;
+            if (rawH264 && tsGen.next(readPkt->data, readPkt->size, 0, framePts, frameDts)) {
+                // 以帧为单位的时间戳，直接换算到输入时间基，后面统一换算到输出
+                AVRational frameTb = av_inv_q(fps);
+                readPkt->pts       = av_rescale_q(framePts, frameTb, inTimebase);
+                readPkt->dts       = av_rescale_q(frameDts, frameTb, inTimebase);
+                readPkt->duration  = av_rescale_q(1, frameTb, inTimebase);
+            } else if (readPkt->pts == AV_NOPTS_VALUE) {
+                // 其他没有时间戳的输入，按帧率生成
+                AVRational frameRate = inStream_->r_frame_rate.num ? inStream_->r_frame_rate : AVRational{25, 1};
+                readPkt->pts         = av_rescale_q(pktCount, av_inv_q(frameRate), inTimebase);
+                readPkt->duration    = av_rescale_q(1, av_inv_q(frameRate), inTimebase);
+            }
+            if (readPkt->dts == AV_NOPTS_VALUE) {
+                readPkt->dts = readPkt->pts;
+            }
+
+            readPkt->pts = av_rescale_q_rnd(readPkt->pts, inTimebase, outTimebase,
+                                            (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
+            readPkt->dts = av_rescale_q_rnd(readPkt->dts, inTimebase, outTimebase,
+                                            (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
 
-            readPkt->dts = readPkt->pts;
+            readPkt->duration = av_rescale_q(readPkt->duration, inTimebase, outTimebase);
 
-            readPkt->duration = av_rescale_q(readPkt->duration, pFormatCtx_->streams[videoindex]->time_base,
-                                             pFormatOutCtx_->streams[readPkt->stream_index]->time_base);
+            readPkt->stream_index = outStream_->index;
+            if (inStream_->codecpar->codec_id == AV_CODEC_ID_H264 && framer.convert(readPkt) < 0) {
+                std::cout << "nal framing convert failed" << std::endl;
+            }
 
             readPkt->pos = -1;
 
@@ -0,0 +1,169 @@
+/**
+ * @brief 码流级降帧率：解复用后用RateFilter丢掉不被参考的帧/高时域层，再原样封装输出
+ * 全程没有解码器和编码器，代价和stream copy相同
+ */
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "nal_framing.hpp"
+#include "rate-filter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static char  errStr[1024];
+static char *av_get_err(int errnum) {
+    av_strerror(errnum, errStr, sizeof(errStr));
+    return errStr;
+}
+
+// avcC: extradata[0]为1，extradata[4]低两位为NAL长度字段字节数减1；否则是Annex-B
+static int nal_length_size(const AVCodecParameters *par) {
+    if (par->extradata_size >= 7 && par->extradata[0] == 1) {
+        return (par->extradata[4] & 0x03) + 1;
+    }
+    return 0;
+}
+
+static int open_output(AVFormatContext **out_ctx, const std::string &filename, const AVStream *in_stream,
+                       Utils::NalFramer &framer) {
+    int ret = avformat_alloc_output_context2(out_ctx, NULL, NULL, filename.c_str());
+    if (ret < 0) {
+        fprintf(stderr, "alloc output context failed: %s\n", av_get_err(ret));
+        return -1;
+    }
+
+    AVStream *out_stream = avformat_new_stream(*out_ctx, NULL);
+    if (out_stream == nullptr) {
+        return -1;
+    }
+    avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base           = in_stream->time_base;
+
+    // 输入输出封装对NAL分隔方式要求不同时（比如裸流转mp4）在这里转换
+    bool out_avcc = (*out_ctx)->oformat->flags & AVFMT_GLOBALHEADER;
+    if (framer.init_remux(in_stream->codecpar, out_stream->codecpar, out_avcc) < 0) {
+        fprintf(stderr, "no sps/pps in input extradata\n");
+        return -1;
+    }
+
+    if (!((*out_ctx)->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&(*out_ctx)->pb, filename.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fprintf(stderr, "open output failed: %s\n", av_get_err(ret));
+            return -1;
+        }
+    }
+    ret = avformat_write_header(*out_ctx, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "write header failed: %s\n", av_get_err(ret));
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool        drop_non_ref    = true;
+    int         max_temporal_id = -1;
+    std::string input;
+    std::string output;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--keep-nonref") {
+            drop_non_ref = false;
+        } else if (arg == "--layer" && i + 1 < argc) {
+            max_temporal_id = atoi(argv[++i]);
+        } else if (input.empty()) {
+            input = arg;
+        } else {
+            output = arg;
+        }
+    }
+    if (input.empty() || output.empty() || (!drop_non_ref && max_temporal_id < 0)) {
+        fprintf(stderr, "%s [--keep-nonref] [--layer N] inputfile outputfile\n", argv[0]);
+        fprintf(stderr, "  --keep-nonref  do not drop frames with nal_ref_idc == 0\n");
+        fprintf(stderr, "  --layer N      keep temporal layers with temporal_id <= N (needs svc prefix nal)\n");
+        return -1;
+    }
+
+    AVFormatContext *in_ctx  = nullptr;
+    AVFormatContext *out_ctx = nullptr;
+    AVPacket        *pkt     = av_packet_alloc();
+    RateFilter       filter;
+    Utils::NalFramer framer;
+    int              video_index = -1;
+    int              ret         = -1;
+
+    do {
+        ret = avformat_open_input(&in_ctx, input.c_str(), NULL, NULL);
+        if (ret < 0) {
+            fprintf(stderr, "format open failed: %s\n", av_get_err(ret));
+            break;
+        }
+        ret = avformat_find_stream_info(in_ctx, NULL);
+        if (ret < 0) {
+            fprintf(stderr, "find stream info failed: %s\n", av_get_err(ret));
+            break;
+        }
+        video_index = av_find_best_stream(in_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (video_index < 0 || in_ctx->streams[video_index]->codecpar->codec_id != AV_CODEC_ID_H264) {
+            fprintf(stderr, "no h264 video stream: %s\n", input.c_str());
+            ret = -1;
+            break;
+        }
+
+        const AVStream *in_stream = in_ctx->streams[video_index];
+        if ((ret = filter.init(nal_length_size(in_stream->codecpar), drop_non_ref, max_temporal_id)) < 0) {
+            break;
+        }
+        if ((ret = open_output(&out_ctx, output, in_stream, framer)) < 0) {
+            break;
+        }
+
+        // 送入一个packet（或nullptr冲刷）后把能取出的都写出去
+        auto write_filtered = [&](AVPacket *in) {
+            filter.send_packet(in);
+            while (filter.receive_packet(pkt) == 0) {
+                av_packet_rescale_ts(pkt, in_stream->time_base, out_ctx->streams[0]->time_base);
+                pkt->stream_index = 0;
+                pkt->pos          = -1;
+                if (framer.convert(pkt) < 0) {
+                    fprintf(stderr, "nal framing convert failed\n");
+                }
+                if (av_interleaved_write_frame(out_ctx, pkt) < 0) {
+                    fprintf(stderr, "write packet failed\n");
+                }
+            }
+        };
+
+        while (av_read_frame(in_ctx, pkt) >= 0) {
+            if (pkt->stream_index != video_index) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            write_filtered(pkt);
+        }
+        write_filtered(nullptr);
+
+        av_write_trailer(out_ctx);
+        ret = 0;
+    } while (0);
+
+    const RateFilter::Stats &stats = filter.stats();
+    fprintf(stderr, "packets in: %llu, out: %llu, dropped: %llu\n", (unsigned long long)stats.in,
+            (unsigned long long)stats.out, (unsigned long long)stats.dropped);
+
+    if (out_ctx && !(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&out_ctx->pb);
+    }
+    avformat_free_context(out_ctx);
+    avformat_close_input(&in_ctx);
+    av_packet_free(&pkt);
+    return ret < 0 ? -1 : 0;
+}
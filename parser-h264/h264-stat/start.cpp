@@ -0,0 +1,386 @@
+/**
+ * @brief H264/H265码流统计，不解码任何像素，只用H264_BS解析NAL/slice头
+ * 输出每一帧的类型、大小，每秒码率，GOP长度和I/P/B直方图，格式为CSV或JSON
+ * 裸流文件直接内存映射后扫描起始码；封装格式（mp4/ts/flv等）只解复用取packet
+ */
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "h264bs.hpp"
+#include "mapped_file.hpp"
+#include "nal_iterator.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using H264_BS::CodecType;
+using H264_BS::FrameType;
+using H264_BS::MediaDetector;
+
+struct FrameStat {
+    uint64_t  index  = 0;
+    uint64_t  offset = 0;   // 裸流里是文件偏移，封装格式里是packet的pos
+    double    time   = 0.0; // 秒
+    FrameType type   = H264_BS::FRAME_TYPE_UNKNOWN;
+    bool      idr    = false;
+    uint64_t  size   = 0;
+};
+
+class StatCollector {
+public:
+    StatCollector(bool json, bool frames)
+        : json_(json)
+        , frames_(frames) {}
+
+    void begin() {
+        if (json_) {
+            printf("{\n  \"frames\": [");
+        } else if (frames_) {
+            printf("# frames\nindex,offset,time,type,idr,size\n");
+        }
+    }
+
+    void add(const FrameStat &f) {
+        if (frames_) {
+            if (json_) {
+                printf("%s\n    {\"index\": %llu, \"offset\": %llu, \"time\": %.6f, \"type\": \"%s\", \"idr\": %s, "
+                       "\"size\": %llu}",
+                       f.index ? "," : "", (unsigned long long)f.index, (unsigned long long)f.offset, f.time,
+                       MediaDetector::type2str(f.type).c_str(), f.idr ? "true" : "false",
+                       (unsigned long long)f.size);
+            } else {
+                printf("%llu,%llu,%.6f,%s,%d,%llu\n", (unsigned long long)f.index, (unsigned long long)f.offset,
+                       f.time, MediaDetector::type2str(f.type).c_str(), f.idr ? 1 : 0, (unsigned long long)f.size);
+            }
+        }
+
+        // I帧（包括IDR）作为GOP的开始
+        if (f.type == H264_BS::FRAME_TYPE_I || f.idr) {
+            if (gop_frames_) {
+                gops_.push_back(gop_frames_);
+            }
+            gop_frames_ = 0;
+        }
+        gop_frames_++;
+
+        Histogram &h = histogram_[f.idr ? std::string("IDR") : MediaDetector::type2str(f.type)];
+        h.count++;
+        h.bytes += f.size;
+
+        bitrate_[(int64_t)std::floor(f.time)] += f.size;
+        total_bytes_ += f.size;
+        total_frames_++;
+        if (total_frames_ == 1 || f.time > last_time_) {
+            last_time_ = f.time;
+        }
+    }
+
+    void finish(double frame_duration) {
+        if (gop_frames_) {
+            gops_.push_back(gop_frames_);
+        }
+        double duration = last_time_ + frame_duration;
+        double avg_kbps = duration > 0 ? total_bytes_ * 8 / duration / 1000 : 0;
+
+        if (json_) {
+            printf("%s],\n  \"bitrate\": [", frames_ ? "\n  " : "");
+            const char *sep = "";
+            for (auto &b : bitrate_) {
+                printf("%s\n    {\"second\": %lld, \"bytes\": %llu, \"kbps\": %.1f}", sep, (long long)b.first,
+                       (unsigned long long)b.second, b.second * 8 / 1000.0);
+                sep = ",";
+            }
+            printf("\n  ],\n  \"gops\": [");
+            sep = "";
+            for (auto g : gops_) {
+                printf("%s%llu", sep, (unsigned long long)g);
+                sep = ", ";
+            }
+            printf("],\n  \"histogram\": {");
+            sep = "";
+            for (auto &h : histogram_) {
+                printf("%s\n    \"%s\": {\"count\": %llu, \"bytes\": %llu}", sep, h.first.c_str(),
+                       (unsigned long long)h.second.count, (unsigned long long)h.second.bytes);
+                sep = ",";
+            }
+            printf("\n  },\n  \"summary\": {\"frames\": %llu, \"bytes\": %llu, \"duration\": %.3f, "
+                   "\"avg_kbps\": %.1f, \"gop_count\": %zu}\n}\n",
+                   (unsigned long long)total_frames_, (unsigned long long)total_bytes_, duration, avg_kbps,
+                   gops_.size());
+        } else {
+            printf("# bitrate\nsecond,bytes,kbps\n");
+            for (auto &b : bitrate_) {
+                printf("%lld,%llu,%.1f\n", (long long)b.first, (unsigned long long)b.second,
+                       b.second * 8 / 1000.0);
+            }
+            printf("# gops\ngop,frames\n");
+            for (size_t i = 0; i < gops_.size(); i++) {
+                printf("%zu,%llu\n", i, (unsigned long long)gops_[i]);
+            }
+            printf("# histogram\ntype,count,bytes\n");
+            for (auto &h : histogram_) {
+                printf("%s,%llu,%llu\n", h.first.c_str(), (unsigned long long)h.second.count,
+                       (unsigned long long)h.second.bytes);
+            }
+            printf("# summary\nframes,bytes,duration,avg_kbps,gop_count\n%llu,%llu,%.3f,%.1f,%zu\n",
+                   (unsigned long long)total_frames_, (unsigned long long)total_bytes_, duration, avg_kbps,
+                   gops_.size());
+        }
+    }
+
+private:
+    struct Histogram {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+
+    bool json_   = false;
+    bool frames_ = true;
+
+    uint64_t                     gop_frames_ = 0;
+    std::vector<uint64_t>        gops_;
+    std::map<std::string, Histogram> histogram_;
+    std::map<int64_t, uint64_t>  bitrate_; // 每秒的字节数
+
+    uint64_t total_bytes_  = 0;
+    uint64_t total_frames_ = 0;
+    double   last_time_    = 0.0;
+};
+
+// H265的slice头里有PPS决定的额外比特，解析slice_type前要知道，遇到PPS时记下来
+static void update_extra_bits(const uint8_t *nal, size_t nal_size, CodecType codec, int &extra_bits) {
+    if (codec == H264_BS::CODEC_H265 && MediaDetector::getNalType(nal, codec) == 34) {
+        extra_bits = MediaDetector::getExtraSliceHeaderBits(nal, nal_size);
+    }
+}
+
+// 裸流：按起始码切NAL，再按访问单元的规则组帧
+static int stat_raw(const std::string &filename, double fps, CodecType codec, StatCollector &collector) {
+    Utils::MappedFile map;
+    if (map.open(filename, true) < 0) {
+        fprintf(stderr, "map file failed: %s\n", filename.c_str());
+        return -1;
+    }
+    const uint8_t *begin = map.data();
+    const uint8_t *end   = begin + map.size();
+
+    FrameStat      frame;
+    const uint8_t *au_start = nullptr;
+    bool           has_vcl  = false;
+    uint64_t       index    = 0;
+    int            extra    = 0;
+
+    auto emit = [&](const uint8_t *au_end) {
+        if (au_start && has_vcl) {
+            frame.index  = index;
+            frame.offset = au_start - begin;
+            frame.time   = index / fps;
+            frame.size   = au_end - au_start;
+            collector.add(frame);
+            index++;
+        }
+        frame    = FrameStat();
+        au_start = au_end;
+        has_vcl  = false;
+    };
+
+    Utils::NalIterator<Utils::NalFraming::ANNEXB> it(begin, end - begin);
+    Utils::NalUnit                                unit;
+    while (it.next(unit)) {
+        const uint8_t *nal      = unit.data;
+        size_t         nal_size = unit.size;
+        // 起始码（含前面的0）算作这个NAL所在的帧
+        const uint8_t *sc = nal - unit.prefix;
+
+        int type = MediaDetector::getNalType(nal, codec);
+        // AUD/SPS/PPS/SEI或者新一帧的第一个slice出现在slice之后，说明上一帧结束了
+        bool slice    = MediaDetector::isSlice(type, codec);
+        bool boundary = MediaDetector::startsAccessUnit(type, codec) ||
+                        (slice && MediaDetector::isFirstSlice(nal, nal_size, codec));
+        if (au_start == nullptr) {
+            au_start = sc;
+        } else if (has_vcl && boundary) {
+            emit(sc);
+        }
+        update_extra_bits(nal, nal_size, codec, extra);
+        if (slice && !has_vcl) {
+            frame.type = MediaDetector::getType(nal, nal_size, codec, extra);
+            frame.idr  = MediaDetector::isIdr(type, codec);
+            has_vcl    = true;
+        }
+
+        map.advance(nal + nal_size - begin);
+    }
+    emit(end);
+    collector.finish(1.0 / fps);
+    return 0;
+}
+
+// 一个packet里的NAL：AVCC是length_size字节的长度前缀，否则是起始码
+static void classify_packet(const uint8_t *data, size_t size, int length_size, CodecType codec, int &extra_bits,
+                            FrameStat &frame) {
+    bool has_type = false;
+    Utils::forEachNal(data, size, length_size, [&](const Utils::NalUnit &nal) {
+        int type = MediaDetector::getNalType(nal.data, codec);
+        if (MediaDetector::isIdr(type, codec)) {
+            frame.idr = true;
+        }
+        update_extra_bits(nal.data, nal.size, codec, extra_bits);
+        if (MediaDetector::isSlice(type, codec) && !has_type) {
+            frame.type = MediaDetector::getType(nal.data, nal.size, codec, extra_bits);
+            has_type   = true;
+        }
+        return true;
+    });
+}
+
+// hvcC：22字节头之后是numOfArrays个NAL数组，每个数组为1字节类型、2字节个数，每个NAL带2字节长度
+static int hvcc_extra_bits(const uint8_t *data, size_t size) {
+    int extra = 0;
+    if (size < 23) {
+        return extra;
+    }
+    const uint8_t *p      = data + 23;
+    const uint8_t *end    = data + size;
+    int            arrays = data[22];
+    for (int i = 0; i < arrays && p + 3 <= end; i++) {
+        int count = (p[1] << 8) | p[2];
+        p += 3;
+        for (int j = 0; j < count && p + 2 <= end; j++) {
+            size_t len = (p[0] << 8) | p[1];
+            p += 2;
+            if (len > (size_t)(end - p)) {
+                return extra;
+            }
+            update_extra_bits(p, len, H264_BS::CODEC_H265, extra);
+            p += len;
+        }
+    }
+    return extra;
+}
+
+// 封装格式：只解复用，不打开解码器
+static int stat_container(AVFormatContext *fmt_ctx, int video_index, StatCollector &collector) {
+    AVStream          *stream = fmt_ctx->streams[video_index];
+    AVCodecParameters *par    = stream->codecpar;
+    CodecType          codec  = par->codec_id == AV_CODEC_ID_HEVC ? H264_BS::CODEC_H265 : H264_BS::CODEC_H264;
+
+    // avcC/hvcC的extradata第一个字节为1，avcC第5个字节、hvcC第22个字节低两位是长度前缀字节数减1
+    int length_size = 0;
+    int extra_bits  = 0;
+    if (codec == H264_BS::CODEC_H265) {
+        if (par->extradata_size >= 23 && par->extradata[0] == 1) {
+            length_size = (par->extradata[21] & 0x03) + 1;
+            extra_bits  = hvcc_extra_bits(par->extradata, par->extradata_size);
+        }
+    } else if (par->extradata_size >= 7 && par->extradata[0] == 1) {
+        length_size = (par->extradata[4] & 0x03) + 1;
+    }
+
+    double frame_duration = 0.04;
+    if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+        frame_duration = av_q2d(av_inv_q(stream->avg_frame_rate));
+    }
+
+    AVPacket *pkt   = av_packet_alloc();
+    uint64_t  index = 0;
+    int64_t   first = AV_NOPTS_VALUE;
+    while (av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index == video_index && pkt->size > 0) {
+            FrameStat frame;
+            frame.index  = index++;
+            frame.offset = pkt->pos < 0 ? 0 : (uint64_t)pkt->pos;
+            frame.size   = pkt->size;
+
+            int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                if (first == AV_NOPTS_VALUE) {
+                    first = ts;
+                }
+                frame.time = (ts - first) * av_q2d(stream->time_base);
+            } else {
+                frame.time = frame.index * frame_duration;
+            }
+
+            classify_packet(pkt->data, pkt->size, length_size, codec, extra_bits, frame);
+            collector.add(frame);
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    collector.finish(frame_duration);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool        json   = false;
+    bool        frames = true;
+    double      fps    = 25.0;
+    std::string filename;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--csv") {
+            json = false;
+        } else if (arg == "--summary") {
+            frames = false;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            fps = atof(argv[++i]);
+        } else {
+            filename = arg;
+        }
+    }
+    if (filename.empty() || fps <= 0) {
+        fprintf(stderr, "%s [--csv|--json] [--summary] [--fps N] inputfile\n", argv[0]);
+        fprintf(stderr, "  --fps  frame rate of raw h264/hevc files (default 25)\n");
+        return -1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    // 输出量大，加大stdout缓冲
+    static char outbuf[1 << 20];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    AVFormatContext *fmt_ctx = nullptr;
+    int              ret     = avformat_open_input(&fmt_ctx, filename.c_str(), NULL, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "format open failed: %s\n", filename.c_str());
+        return -1;
+    }
+
+    StatCollector collector(json, frames);
+
+    // 裸H264/H265文件不走解复用器，直接映射文件扫描
+    bool raw_h264 = strcmp(fmt_ctx->iformat->name, "h264") == 0;
+    bool raw_hevc = strcmp(fmt_ctx->iformat->name, "hevc") == 0;
+    if (raw_h264 || raw_hevc) {
+        avformat_close_input(&fmt_ctx);
+        collector.begin();
+        ret = stat_raw(filename, fps, raw_hevc ? H264_BS::CODEC_H265 : H264_BS::CODEC_H264, collector);
+        return ret;
+    }
+
+    int       video_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    AVCodecID codec_id    = video_index < 0 ? AV_CODEC_ID_NONE : fmt_ctx->streams[video_index]->codecpar->codec_id;
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC) {
+        fprintf(stderr, "no h264/hevc video stream: %s\n", filename.c_str());
+        avformat_close_input(&fmt_ctx);
+        return -1;
+    }
+
+    collector.begin();
+    ret = stat_container(fmt_ctx, video_index, collector);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
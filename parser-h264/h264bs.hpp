@@ -1,8 +1,16 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 
-// 获取H264帧格式
+#include "nal_iterator.hpp"
+
+// 获取H264/H265帧格式
 namespace H264_BS {
+    typedef enum { CODEC_H264 = 0, CODEC_H265 = 1 } CodecType;
+
     typedef enum {
         FRAME_TYPE_UNKNOWN = 0,
         FRAME_TYPE_I       = 15,
@@ -12,6 +20,24 @@ namespace H264_BS {
         FRAME_TYPE_SI      = 19
     } FrameType;
 
+    // SPS里和时间戳相关的字段，解析失败时valid为false
+    struct SpsInfo {
+        bool     valid                  = false;
+        int      profile_idc            = 0;
+        int      level_idc              = 0;
+        bool     separate_colour_plane  = false;
+        int      log2_max_frame_num     = 4;
+        int      poc_type               = 0;
+        int      log2_max_poc_lsb       = 4;
+        int      max_num_ref_frames     = 0;
+        bool     frame_mbs_only         = true;
+        bool     timing_info_present    = false;
+        uint32_t num_units_in_tick      = 0;
+        uint32_t time_scale             = 0;
+        bool     fixed_frame_rate       = false;
+        int      max_num_reorder_frames = -1; // 没有bitstream_restriction时为-1
+    };
+
     class MediaDetector {
     public:
         MediaDetector() {}
@@ -50,15 +76,130 @@ namespace H264_BS {
             return typeStr;
         }
 
-        // 不带start code的一帧数据
-        static FrameType getType(unsigned char *data, size_t size) {
-            if (data == nullptr) {
+        // NAL头里的nal_unit_type，data不带start code；H265的NAL头为2字节，类型在第一个字节的1~6位
+        static int getNalType(const unsigned char *data, CodecType codec = CODEC_H264) {
+            return codec == CODEC_H265 ? (data[0] >> 1) & 0x3f : data[0] & 0x1f;
+        }
+
+        // 是否是图像数据(VCL) NAL，H264的1~5为slice，H265的0~9、16~21为slice
+        static bool isSlice(int nal_type, CodecType codec = CODEC_H264) {
+            if (codec == CODEC_H265) {
+                return nal_type <= 9 || (nal_type >= 16 && nal_type <= 21);
+            }
+            return nal_type >= 1 && nal_type <= 5;
+        }
+
+        // H264的IDR(5)，H265的IDR_W_RADL(19)、IDR_N_LP(20)
+        static bool isIdr(int nal_type, CodecType codec = CODEC_H264) {
+            return codec == CODEC_H265 ? (nal_type == 19 || nal_type == 20) : nal_type == 5;
+        }
+
+        // 随机接入点：H265的IRAP包括BLA(16~18)、IDR(19~20)、CRA(21)，H264只有IDR
+        static bool isIrap(int nal_type, CodecType codec = CODEC_H264) {
+            return codec == CODEC_H265 ? (nal_type >= 16 && nal_type <= 23) : nal_type == 5;
+        }
+
+        // 参数集：H264的SPS(7)/PPS(8)，H265的VPS(32)/SPS(33)/PPS(34)
+        static bool isParamSet(int nal_type, CodecType codec = CODEC_H264) {
+            return codec == CODEC_H265 ? (nal_type >= 32 && nal_type <= 34) : (nal_type == 7 || nal_type == 8);
+        }
+
+        // 出现在slice之后就表示上一帧已经结束的非VCL NAL（参数集、AUD、前缀SEI等）
+        static bool startsAccessUnit(int nal_type, CodecType codec = CODEC_H264) {
+            if (codec == CODEC_H265) {
+                return (nal_type >= 32 && nal_type <= 35) || nal_type == 39 || (nal_type >= 41 && nal_type <= 44) ||
+                       (nal_type >= 48 && nal_type <= 55);
+            }
+            return nal_type >= 6 && nal_type <= 9;
+        }
+
+        // slice头的first_mb_in_slice是否为0（H265为first_slice_segment_in_pic_flag），即这个slice是一帧的开始
+        static bool isFirstSlice(const unsigned char *data, size_t size, CodecType codec = CODEC_H264) {
+            size_t header = codec == CODEC_H265 ? 2 : 1;
+            if (data == nullptr || size < header + 1) {
+                return false;
+            }
+            // ue(v)编码的0就是单独一个比特1
+            return (data[header] & 0x80) != 0;
+        }
+
+        /**
+         * @brief H265 PPS里的num_extra_slice_header_bits，解析slice_type时要跳过这些比特
+         * 大部分编码器为0，没有PPS时按0处理
+         */
+        static int getExtraSliceHeaderBits(const unsigned char *pps, size_t size) {
+            if (pps == nullptr || size < 3) {
+                return 0;
+            }
+            bs_t s;
+            bs_init(&s, (void *)(pps + 2), size - 2);
+            bs_read_ue(&s); // pps_pic_parameter_set_id
+            bs_read_ue(&s); // pps_seq_parameter_set_id
+            bs_read1(&s);   // dependent_slice_segments_enabled_flag
+            bs_read1(&s);   // output_flag_present_flag
+            return bs_read(&s, 3);
+        }
+
+        /**
+         * @brief 依次取出一段码流里的每个NAL（不带start code/长度字段），f返回false时停止
+         * length_size为0表示Annex-B（start code分隔），否则为AVCC格式NAL长度字段的字节数
+         */
+        template <typename F>
+        static void forEachNal(const unsigned char *data, size_t size, int length_size, F f) {
+            Utils::forEachNal(data, size, length_size,
+                              [&](const Utils::NalUnit &nal) { return f(nal.data, nal.size); });
+        }
+
+        // 一个访问单元是否可以单独解码：含IDR（H265为IRAP）slice，或者所有slice都是I/SI
+        static bool isKeyFrame(const unsigned char *data, size_t size, int length_size = 0,
+                               CodecType codec = CODEC_H264) {
+            bool intra = false;
+            bool inter = false;
+            bool idr   = false;
+            int  extra = 0;
+            forEachNal(data, size, length_size, [&](const unsigned char *nal, size_t nal_size) {
+                int type = getNalType(nal, codec);
+                if (isIrap(type, codec)) {
+                    idr = true;
+                    return false;
+                }
+                if (codec == CODEC_H265 && type == 34) {
+                    extra = getExtraSliceHeaderBits(nal, nal_size);
+                }
+                if (codec == CODEC_H265 ? isSlice(type, codec) : type == 1) {
+                    // 只有一帧的第一个slice能不依赖SPS解析出slice_type
+                    if (codec == CODEC_H265 && !isFirstSlice(nal, nal_size, codec)) {
+                        return true;
+                    }
+                    FrameType t = getType(nal, nal_size, codec, extra);
+                    if (t != FRAME_TYPE_I && t != FRAME_TYPE_SI) {
+                        inter = true;
+                        return false;
+                    }
+                    intra = true;
+                }
+                return true;
+            });
+            return idr || (intra && !inter);
+        }
+
+        /**
+         * @brief 不带start code的一帧数据
+         * H265只能解析一帧的第一个slice（其余slice的slice_segment_address长度取决于SPS），
+         * extra_bits为PPS里的num_extra_slice_header_bits
+         */
+        static FrameType getType(const unsigned char *data, size_t size, CodecType codec = CODEC_H264,
+                                 int extra_bits = 0) {
+            if (codec == CODEC_H265) {
+                return getH265Type(data, size, extra_bits);
+            }
+            if (data == nullptr || size < 2) {
                 return FRAME_TYPE_UNKNOWN;
             }
             bs_t s;
             int  frame_type_num = 0;
 
-            bs_init(&s, data + 1, size - 1);
+            bs_init(&s, (void *)(data + 1), size - 1);
 
             bs_read_ue(&s);
             frame_type_num      = bs_read_ue(&s);
@@ -91,8 +232,415 @@ namespace H264_BS {
             return frameType;
         }
 
+        // 解析不带start code的SPS NAL
+        static bool parseSps(const unsigned char *nal, size_t size, SpsInfo &info) {
+            SpsLayout layout;
+            return parseSps(nal, size, info, layout);
+        }
+
+        /**
+         * @brief 改写SPS的VUI timing_info，帧率为fps_num/fps_den，不重新编码就能让码流带上正确帧率
+         * 没有VUI时补一个只有timing_info的VUI，其余字段原样保留；out为不带start code的新SPS
+         */
+        static bool rewriteSpsTiming(const unsigned char *nal, size_t size, uint32_t fps_num, uint32_t fps_den,
+                                     std::vector<uint8_t> &out) {
+            SpsInfo   info;
+            SpsLayout layout;
+            if (fps_num == 0 || fps_den == 0 || !parseSps(nal, size, info, layout)) {
+                return false;
+            }
+            const std::vector<uint8_t> &rbsp = layout.rbsp;
+
+            size_t stop = 0;
+            if (!findStopBit(rbsp, stop)) {
+                return false;
+            }
+
+            BitWriter w;
+            if (layout.vui_present) {
+                copyBits(w, rbsp, 0, layout.timing_begin);
+            } else {
+                copyBits(w, rbsp, 0, layout.vui_flag);
+                w.put(1, 1); // vui_parameters_present_flag
+                w.put(0, 4); // aspect_ratio/overscan/video_signal_type/chroma_loc_info_present_flag
+            }
+            // 帧率 = time_scale / (2 * num_units_in_tick)
+            w.put(1, 1);
+            w.put(fps_den, 32);
+            w.put(fps_num * 2, 32);
+            w.put(1, 1); // fixed_frame_rate_flag
+            if (layout.vui_present) {
+                copyBits(w, rbsp, layout.timing_end, stop);
+            } else {
+                w.put(0, 4); // nal/vcl_hrd、pic_struct、bitstream_restriction都没有
+            }
+            w.put(1, 1); // rbsp_stop_one_bit
+            while (w.bits % 8) {
+                w.put(0, 1);
+            }
+
+            // 加上防竞争字节
+            out.assign(1, nal[0]);
+            int zeros = 0;
+            for (uint8_t b : w.data) {
+                if (zeros >= 2 && b <= 3) {
+                    out.push_back(3);
+                    zeros = 0;
+                }
+                out.push_back(b);
+                zeros = b == 0 ? zeros + 1 : 0;
+            }
+
+            // 重新解析一遍：帧率要对上，VUI结束（bitstream_restriction_flag及其内容之后）紧跟rbsp_stop_one_bit
+            SpsInfo   check;
+            SpsLayout check_layout;
+            size_t    check_stop = 0;
+            if (!parseSps(out.data(), out.size(), check, check_layout) || !check.timing_info_present ||
+                check.num_units_in_tick != fps_den || check.time_scale != fps_num * 2 ||
+                !findStopBit(check_layout.rbsp, check_stop) || check_stop != check_layout.vui_end) {
+                out.clear();
+                return false;
+            }
+            return true;
+        }
+
+        // 参数集的id：SPS的seq_parameter_set_id、PPS的pic_parameter_set_id，H265还有VPS的vps_video_parameter_set_id；
+        // nal不带start code，其他NAL返回-1
+        static int getParameterSetId(const unsigned char *nal, size_t size, CodecType codec = CODEC_H264) {
+            int header = codec == CODEC_H265 ? 2 : 1;
+            if (nal == nullptr || size <= (size_t)header) {
+                return -1;
+            }
+            int type = getNalType(nal, codec);
+            if (!isParamSet(type, codec)) {
+                return -1;
+            }
+            // H265的SPS id在profile_tier_level之后，最多7个子层时也在前128字节里
+            std::vector<uint8_t> rbsp;
+            unescape(nal + header, size - header < 128 ? size - header : 128, rbsp);
+
+            bs_t s;
+            bs_init(&s, rbsp.data(), (int)rbsp.size());
+            int id = -1;
+            if (codec == CODEC_H265 && type == 32) {
+                id = (int)bs_read(&s, 4); // vps_video_parameter_set_id
+            } else if (codec == CODEC_H265 && type == 33) {
+                bs_read(&s, 4); // sps_video_parameter_set_id
+                int sub_layers = (int)bs_read(&s, 3);
+                bs_read1(&s); // sps_temporal_id_nesting_flag
+                skipProfileTierLevel(&s, sub_layers);
+                id = (int)bs_read_ue(&s);
+            } else {
+                if (type == 7) {
+                    bs_read(&s, 24); // profile_idc、constraint_set flags、level_idc
+                }
+                id = (int)bs_read_ue(&s);
+            }
+            return s.p < s.p_end ? id : -1;
+        }
+
+        // 一帧第一个slice的pic_order_cnt_lsb，只有POC type 0才有
+        static bool getPocLsb(const unsigned char *nal, size_t size, const SpsInfo &sps, int &poc_lsb) {
+            if (nal == nullptr || size < 2 || !sps.valid || sps.poc_type != 0) {
+                return false;
+            }
+            int type = getNalType(nal);
+            if (type != 1 && type != 5) {
+                return false;
+            }
+            // slice头在前几十个字节里，只对这部分去防竞争字节
+            std::vector<uint8_t> rbsp;
+            unescape(nal + 1, size - 1 < 64 ? size - 1 : 64, rbsp);
+
+            bs_t s;
+            bs_init(&s, rbsp.data(), (int)rbsp.size());
+            bs_read_ue(&s); // first_mb_in_slice
+            bs_read_ue(&s); // slice_type
+            bs_read_ue(&s); // pic_parameter_set_id
+            if (sps.separate_colour_plane) {
+                bs_read(&s, 2); // colour_plane_id
+            }
+            bs_read(&s, sps.log2_max_frame_num); // frame_num
+            if (!sps.frame_mbs_only && bs_read1(&s)) {
+                bs_read1(&s); // bottom_field_flag
+            }
+            if (type == 5) {
+                bs_read_ue(&s); // idr_pic_id
+            }
+            poc_lsb = (int)bs_read(&s, sps.log2_max_poc_lsb);
+            return s.p < s.p_end;
+        }
 
     private:
+        // 改写SPS时需要的各个字段在RBSP里的比特位置（不含NAL头）
+        struct SpsLayout {
+            std::vector<uint8_t> rbsp;
+            bool                 vui_present  = false;
+            size_t               vui_flag     = 0; // vui_parameters_present_flag
+            size_t               timing_begin = 0; // timing_info_present_flag
+            size_t               timing_end   = 0; // timing_info之后的第一个比特
+            size_t               vui_end      = 0; // VUI（没有VUI时为vui_parameters_present_flag）之后的第一个比特
+        };
+
+        struct BitWriter {
+            std::vector<uint8_t> data;
+            size_t               bits = 0;
+
+            void put(uint32_t value, int count) {
+                for (int i = count - 1; i >= 0; i--) {
+                    if (bits % 8 == 0) {
+                        data.push_back(0);
+                    }
+                    if ((value >> i) & 1) {
+                        data.back() |= 0x80 >> (bits % 8);
+                    }
+                    bits++;
+                }
+            }
+        };
+
+        static bool getBit(const std::vector<uint8_t> &data, size_t pos) {
+            return (data[pos / 8] >> (7 - pos % 8)) & 1;
+        }
+
+        // rbsp_stop_one_bit的位置，之后都是补齐的0
+        static bool findStopBit(const std::vector<uint8_t> &rbsp, size_t &stop) {
+            stop = rbsp.size() * 8;
+            while (stop > 0 && !getBit(rbsp, stop - 1)) {
+                stop--;
+            }
+            if (stop == 0) {
+                return false;
+            }
+            stop--;
+            return true;
+        }
+
+        static void copyBits(BitWriter &w, const std::vector<uint8_t> &data, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                w.put(getBit(data, i), 1);
+            }
+        }
+
+        static size_t bs_pos(const bs_t *s) {
+            return (s->p - s->p_start) * 8 + (8 - s->i_left);
+        }
+
+        // 去掉防竞争字节00 00 03里的03
+        static void unescape(const unsigned char *data, size_t size, std::vector<uint8_t> &rbsp) {
+            rbsp.clear();
+            rbsp.reserve(size);
+            int zeros = 0;
+            for (size_t i = 0; i < size; i++) {
+                if (zeros >= 2 && data[i] == 3) {
+                    zeros = 0;
+                    continue;
+                }
+                rbsp.push_back(data[i]);
+                zeros = data[i] == 0 ? zeros + 1 : 0;
+            }
+        }
+
+        static void skipScalingList(bs_t *s, int size) {
+            int last = 8, next = 8;
+            for (int i = 0; i < size; i++) {
+                if (next != 0) {
+                    next = (last + bs_read_se(s) + 256) % 256;
+                }
+                last = next == 0 ? last : next;
+            }
+        }
+
+        // H265的profile_tier_level(1, sps_max_sub_layers_minus1)
+        static void skipProfileTierLevel(bs_t *s, int sub_layers) {
+            // general部分共96位：profile_space/tier/profile_idc 8位、32个compatibility flag、
+            // 4个source/constraint flag、43个保留位、inbld_flag、general_level_idc 8位
+            bs_read(s, 32);
+            bs_read(s, 32);
+            bs_read(s, 32);
+            int profile_present[8] = {0};
+            int level_present[8]   = {0};
+            for (int i = 0; i < sub_layers; i++) {
+                profile_present[i] = bs_read1(s);
+                level_present[i]   = bs_read1(s);
+            }
+            if (sub_layers > 0) {
+                bs_read(s, 2 * (8 - sub_layers)); // reserved_zero_2bits
+            }
+            for (int i = 0; i < sub_layers; i++) {
+                if (profile_present[i]) {
+                    // 和general部分一样，没有level_idc，88位
+                    bs_read(s, 32);
+                    bs_read(s, 32);
+                    bs_read(s, 24);
+                }
+                if (level_present[i]) {
+                    bs_read(s, 8);
+                }
+            }
+        }
+
+        static void skipHrd(bs_t *s) {
+            int cpb_cnt = bs_read_ue(s) + 1;
+            bs_read(s, 8); // bit_rate_scale、cpb_size_scale
+            for (int i = 0; i < cpb_cnt && i < 32; i++) {
+                bs_read_ue(s); // bit_rate_value_minus1
+                bs_read_ue(s); // cpb_size_value_minus1
+                bs_read1(s);   // cbr_flag
+            }
+            bs_read(s, 20); // 各种delay_length
+        }
+
+        static bool parseSps(const unsigned char *nal, size_t size, SpsInfo &info, SpsLayout &layout) {
+            info = SpsInfo();
+            if (nal == nullptr || size < 4 || getNalType(nal) != 7) {
+                return false;
+            }
+            unescape(nal + 1, size - 1, layout.rbsp);
+
+            bs_t s;
+            bs_init(&s, layout.rbsp.data(), (int)layout.rbsp.size());
+            info.profile_idc = bs_read(&s, 8);
+            bs_read(&s, 8); // constraint_set flags
+            info.level_idc = bs_read(&s, 8);
+            bs_read_ue(&s); // seq_parameter_set_id
+
+            int p = info.profile_idc;
+            if (p == 100 || p == 110 || p == 122 || p == 244 || p == 44 || p == 83 || p == 86 || p == 118 ||
+                p == 128 || p == 138 || p == 139 || p == 134 || p == 135) {
+                int chroma_format_idc = bs_read_ue(&s);
+                if (chroma_format_idc == 3) {
+                    info.separate_colour_plane = bs_read1(&s);
+                }
+                bs_read_ue(&s); // bit_depth_luma_minus8
+                bs_read_ue(&s); // bit_depth_chroma_minus8
+                bs_read1(&s);   // qpprime_y_zero_transform_bypass_flag
+                if (bs_read1(&s)) {
+                    int lists = chroma_format_idc == 3 ? 12 : 8;
+                    for (int i = 0; i < lists; i++) {
+                        if (bs_read1(&s)) {
+                            skipScalingList(&s, i < 6 ? 16 : 64);
+                        }
+                    }
+                }
+            }
+
+            info.log2_max_frame_num = bs_read_ue(&s) + 4;
+            info.poc_type           = bs_read_ue(&s);
+            if (info.poc_type == 0) {
+                info.log2_max_poc_lsb = bs_read_ue(&s) + 4;
+            } else if (info.poc_type == 1) {
+                bs_read1(&s);   // delta_pic_order_always_zero_flag
+                bs_read_se(&s); // offset_for_non_ref_pic
+                bs_read_se(&s); // offset_for_top_to_bottom_field
+                int cycle = bs_read_ue(&s);
+                for (int i = 0; i < cycle && i < 256; i++) {
+                    bs_read_se(&s);
+                }
+            }
+            info.max_num_ref_frames = bs_read_ue(&s);
+            bs_read1(&s);   // gaps_in_frame_num_value_allowed_flag
+            bs_read_ue(&s); // pic_width_in_mbs_minus1
+            bs_read_ue(&s); // pic_height_in_map_units_minus1
+            info.frame_mbs_only = bs_read1(&s);
+            if (!info.frame_mbs_only) {
+                bs_read1(&s); // mb_adaptive_frame_field_flag
+            }
+            bs_read1(&s); // direct_8x8_inference_flag
+            if (bs_read1(&s)) {
+                for (int i = 0; i < 4; i++) {
+                    bs_read_ue(&s); // frame_crop_*_offset
+                }
+            }
+
+            layout.vui_flag    = bs_pos(&s);
+            layout.vui_present = bs_read1(&s);
+            if (s.p >= s.p_end) {
+                return false;
+            }
+            if (layout.vui_present) {
+                if (bs_read1(&s) && bs_read(&s, 8) == 255) { // aspect_ratio_idc为Extended_SAR
+                    bs_read(&s, 32);
+                }
+                if (bs_read1(&s)) {
+                    bs_read1(&s); // overscan_appropriate_flag
+                }
+                if (bs_read1(&s)) {
+                    bs_read(&s, 4); // video_format、video_full_range_flag
+                    if (bs_read1(&s)) {
+                        bs_read(&s, 24); // colour_primaries等
+                    }
+                }
+                if (bs_read1(&s)) {
+                    bs_read_ue(&s); // chroma_sample_loc_type_top_field
+                    bs_read_ue(&s); // chroma_sample_loc_type_bottom_field
+                }
+                layout.timing_begin      = bs_pos(&s);
+                info.timing_info_present = bs_read1(&s);
+                if (info.timing_info_present) {
+                    info.num_units_in_tick = bs_read(&s, 32);
+                    info.time_scale        = bs_read(&s, 32);
+                    info.fixed_frame_rate  = bs_read1(&s);
+                }
+                layout.timing_end = bs_pos(&s);
+
+                bool nal_hrd = bs_read1(&s);
+                if (nal_hrd) {
+                    skipHrd(&s);
+                }
+                bool vcl_hrd = bs_read1(&s);
+                if (vcl_hrd) {
+                    skipHrd(&s);
+                }
+                if (nal_hrd || vcl_hrd) {
+                    bs_read1(&s); // low_delay_hrd_flag
+                }
+                bs_read1(&s); // pic_struct_present_flag
+                if (bs_read1(&s)) {
+                    bs_read1(&s);   // motion_vectors_over_pic_boundaries_flag
+                    bs_read_ue(&s); // max_bytes_per_pic_denom
+                    bs_read_ue(&s); // max_bits_per_mb_denom
+                    bs_read_ue(&s); // log2_max_mv_length_horizontal
+                    bs_read_ue(&s); // log2_max_mv_length_vertical
+                    info.max_num_reorder_frames = bs_read_ue(&s);
+                    bs_read_ue(&s); // max_dec_frame_buffering
+                }
+                if (layout.timing_end > layout.rbsp.size() * 8) {
+                    return false;
+                }
+            }
+            layout.vui_end = bs_pos(&s);
+            info.valid     = true;
+            return true;
+        }
+
+        static FrameType getH265Type(const unsigned char *data, size_t size, int extra_bits) {
+            if (!isFirstSlice(data, size, CODEC_H265)) {
+                return FRAME_TYPE_UNKNOWN;
+            }
+            int  type = getNalType(data, CODEC_H265);
+            bs_t s;
+            bs_init(&s, (void *)(data + 2), size - 2);
+            bs_read1(&s); // first_slice_segment_in_pic_flag
+            if (isIrap(type, CODEC_H265)) {
+                bs_read1(&s); // no_output_of_prior_pics_flag
+            }
+            bs_read_ue(&s); // slice_pic_parameter_set_id
+            if (extra_bits > 0) {
+                bs_read(&s, extra_bits); // slice_reserved_flag
+            }
+            switch (bs_read_ue(&s)) {
+            case 0:
+                return FRAME_TYPE_B;
+            case 1:
+                return FRAME_TYPE_P;
+            case 2:
+                return FRAME_TYPE_I;
+            default:
+                return FRAME_TYPE_UNKNOWN;
+            }
+        }
+
         static void bs_init(bs_t *s, void *p_data, int i_data) {
             s->p_start = (unsigned char *)p_data; // 用传入的p_data首地址初始化p_start，只记下有效数据的首地址
             s->p = (unsigned char *)
@@ -250,4 +798,263 @@ namespace H264_BS {
     };
 
 
+    /**
+     * @brief 没有时间戳的H264裸流按解码顺序送入每一帧，按帧率和显示顺序生成pts/dts（单位为帧）
+     * POC type 0按pic_order_cnt_lsb推算显示顺序，type 1/2当作显示顺序等于解码顺序；
+     * dts比解码序号落后重排深度（VUI的max_num_reorder_frames，没有时按参考帧数估计），保证dts <= pts
+     */
+    class TimestampGenerator {
+    public:
+        // 一个访问单元，length_size为0表示Annex-B；没有slice时返回false
+        bool next(const unsigned char *data, size_t size, int length_size, int64_t &pts, int64_t &dts) {
+            bool found = false;
+            bool idr   = false;
+            bool ref   = false;
+            int  lsb   = -1;
+            MediaDetector::forEachNal(data, size, length_size, [&](const unsigned char *nal, size_t nal_size) {
+                int type = MediaDetector::getNalType(nal);
+                if (type == 7) {
+                    setSps(nal, nal_size);
+                } else if (type == 1 || type == 5) {
+                    found = true;
+                    idr   = type == 5;
+                    ref   = (nal[0] & 0x60) != 0;
+                    if (!MediaDetector::getPocLsb(nal, nal_size, sps_, lsb)) {
+                        lsb = -1;
+                    }
+                    return false;
+                }
+                return true;
+            });
+            if (!found) {
+                return false;
+            }
+
+            int64_t index = decoded_;
+            if (lsb >= 0) {
+                index = displayIndex(idr, ref, lsb);
+            }
+            dts = decoded_ - delay_;
+            pts = index > dts ? index : dts;
+            if (pts > max_index_) {
+                max_index_ = pts;
+            }
+            decoded_++;
+            return true;
+        }
+
+        // 码流外（比如extradata里）的SPS
+        void setSps(const unsigned char *nal, size_t size) {
+            SpsInfo info;
+            if (!MediaDetector::parseSps(nal, size, info)) {
+                return;
+            }
+            bool first = !sps_.valid;
+            sps_       = info;
+            // 重排深度只在开始时确定，中途改变会让dts倒退
+            if (first) {
+                if (info.max_num_reorder_frames >= 0) {
+                    delay_ = info.max_num_reorder_frames;
+                } else if (info.poc_type == 2 || info.profile_idc == 66) {
+                    delay_ = 0;
+                } else {
+                    delay_ = info.max_num_ref_frames < 16 ? info.max_num_ref_frames : 16;
+                }
+            }
+        }
+
+        const SpsInfo &sps() const {
+            return sps_;
+        }
+
+        int delay() const {
+            return delay_;
+        }
+
+    private:
+        // 8.2.1.1：由pic_order_cnt_lsb恢复POC，再换算成从当前IDR开始的显示序号
+        int64_t displayIndex(bool idr, bool ref, int lsb) {
+            int max_lsb = 1 << sps_.log2_max_poc_lsb;
+            if (idr) {
+                prev_msb_ = 0;
+                prev_lsb_ = 0;
+            }
+            int msb = prev_msb_;
+            if (lsb < prev_lsb_ && prev_lsb_ - lsb >= max_lsb / 2) {
+                msb += max_lsb;
+            } else if (lsb > prev_lsb_ && lsb - prev_lsb_ > max_lsb / 2) {
+                msb -= max_lsb;
+            }
+            if (ref) {
+                prev_msb_ = msb;
+                prev_lsb_ = lsb;
+            }
+            int64_t poc = (int64_t)msb + lsb;
+
+            // 新的IDR之前的帧都已经显示完，从下一个显示序号接着排
+            if (idr || !started_) {
+                base_      = started_ ? max_index_ + 1 : 0;
+                first_poc_ = poc;
+                started_   = true;
+            }
+            // 一般每帧POC加2，遇到奇数间隔时按每帧加1处理
+            if ((poc - first_poc_) % 2 != 0) {
+                poc_step_ = 1;
+            }
+            return base_ + (poc - first_poc_) / poc_step_;
+        }
+
+    private:
+        SpsInfo sps_;
+        int     delay_     = 0;
+        int64_t decoded_   = 0;
+        int64_t max_index_ = -1;
+
+        bool    started_   = false;
+        int64_t base_      = 0;
+        int64_t first_poc_ = 0;
+        int     poc_step_  = 2;
+        int     prev_msb_  = 0;
+        int     prev_lsb_  = 0;
+    };
+
+    // 时延测量SEI里带的时间戳
+    struct LatencyInfo {
+        uint64_t sequence     = 0;
+        int64_t  wallclock_us = 0; // 系统时间，不同机器之间比较
+        int64_t  monotonic_us = 0; // 单调时钟，只能在同一台机器上比较
+    };
+
+    /**
+     * @brief 时延测量用的SEI（user_data_unregistered，payloadType 5）
+     * 编码端在每帧里写入序号和编码时刻，链路上任意一处解出来和当前时间相减就是这一段的时延
+     */
+    class LatencySei {
+    public:
+        static const uint8_t *uuid() {
+            static const uint8_t id[16] = {0x6c, 0x61, 0x74, 0x65, 0x6e, 0x63, 0x79, 0x2d,
+                                           0x73, 0x65, 0x69, 0x2d, 0x76, 0x30, 0x30, 0x31};
+            return id;
+        }
+
+        static int64_t wallclockUs() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        static int64_t monotonicUs() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        // 生成带4字节start code的SEI NAL，已经加上防竞争字节
+        static std::vector<uint8_t> build(const LatencyInfo &info) {
+            std::vector<uint8_t> rbsp;
+            rbsp.push_back(5);                     // payloadType
+            rbsp.push_back(kUuidSize + kBodySize); // payloadSize
+            rbsp.insert(rbsp.end(), uuid(), uuid() + kUuidSize);
+            put64(rbsp, info.sequence);
+            put64(rbsp, (uint64_t)info.wallclock_us);
+            put64(rbsp, (uint64_t)info.monotonic_us);
+            rbsp.push_back(0x80); // rbsp_trailing_bits
+
+            std::vector<uint8_t> nal   = {0, 0, 0, 1, 6};
+            int                  zeros = 0;
+            for (uint8_t b : rbsp) {
+                if (zeros >= 2 && b <= 3) {
+                    nal.push_back(3);
+                    zeros = 0;
+                }
+                nal.push_back(b);
+                zeros = b == 0 ? zeros + 1 : 0;
+            }
+            return nal;
+        }
+
+        // 解析一个不带start code的SEI NAL，没有时延SEI时返回false
+        static bool parse(const unsigned char *nal, size_t size, LatencyInfo &info) {
+            if (nal == nullptr || size < 2 || (nal[0] & 0x1f) != 6) {
+                return false;
+            }
+            // 去掉防竞争字节
+            std::vector<uint8_t> rbsp;
+            rbsp.reserve(size);
+            int zeros = 0;
+            for (size_t i = 1; i < size; i++) {
+                if (zeros >= 2 && nal[i] == 3) {
+                    zeros = 0;
+                    continue;
+                }
+                rbsp.push_back(nal[i]);
+                zeros = nal[i] == 0 ? zeros + 1 : 0;
+            }
+
+            size_t pos = 0;
+            while (pos < rbsp.size() && rbsp[pos] != 0x80) {
+                size_t type = 0, len = 0;
+                while (pos < rbsp.size() && rbsp[pos] == 0xff) {
+                    type += 255;
+                    pos++;
+                }
+                if (pos >= rbsp.size()) {
+                    return false;
+                }
+                type += rbsp[pos++];
+                while (pos < rbsp.size() && rbsp[pos] == 0xff) {
+                    len += 255;
+                    pos++;
+                }
+                if (pos >= rbsp.size()) {
+                    return false;
+                }
+                len += rbsp[pos++];
+                if (pos + len > rbsp.size()) {
+                    return false;
+                }
+                if (type == 5 && len >= kUuidSize + kBodySize && memcmp(&rbsp[pos], uuid(), kUuidSize) == 0) {
+                    const uint8_t *body = &rbsp[pos + kUuidSize];
+                    info.sequence       = get64(body);
+                    info.wallclock_us   = (int64_t)get64(body + 8);
+                    info.monotonic_us   = (int64_t)get64(body + 16);
+                    return true;
+                }
+                pos += len;
+            }
+            return false;
+        }
+
+        // 在一个访问单元里找时延SEI，length_size为0表示Annex-B
+        static bool find(const unsigned char *data, size_t size, int length_size, LatencyInfo &info) {
+            bool found = false;
+            MediaDetector::forEachNal(data, size, length_size, [&](const unsigned char *nal, size_t nal_size) {
+                int type = MediaDetector::getNalType(nal);
+                if (type == 6) {
+                    found = parse(nal, nal_size, info);
+                }
+                // SEI都在第一个slice之前
+                return !found && !MediaDetector::isSlice(type);
+            });
+            return found;
+        }
+
+    private:
+        static constexpr size_t kUuidSize = 16;
+        static constexpr size_t kBodySize = 24;
+
+        static void put64(std::vector<uint8_t> &out, uint64_t v) {
+            for (int i = 7; i >= 0; i--) {
+                out.push_back((uint8_t)(v >> (8 * i)));
+            }
+        }
+
+        static uint64_t get64(const uint8_t *p) {
+            uint64_t v = 0;
+            for (int i = 0; i < 8; i++) {
+                v = (v << 8) | p[i];
+            }
+            return v;
+        }
+    };
 }; // namespace H264_BS
\ No newline at end of file
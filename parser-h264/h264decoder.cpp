@@ -1,11 +1,20 @@
 #include "h264decoder.h"
 
+#include <limits.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #define VIDEO_INBUF_SIZE    200000
 #define VIDEO_REFILL_THRESH 4096
+#define GOP_READ_CHUNK      (1 << 20)
 
 static char  err_buf[1280] = {0};
 static char *av_get_err(int errnum) {
@@ -13,8 +22,8 @@ static char *av_get_err(int errnum) {
     return err_buf;
 }
 
-FFMPEGDecoder::FFMPEGDecoder(std::string in, std::string out) {
-    init_inAndout_file(in, out);
+FFMPEGDecoder::FFMPEGDecoder(std::string in, std::string out, AVPixelFormat out_format, bool direct_io) {
+    init_inAndout_file(in, out, out_format, direct_io);
 }
 
 FFMPEGDecoder::~FFMPEGDecoder() {
@@ -40,6 +49,10 @@ int FFMPEGDecoder::init_decoder() {
     }
     pAVCodecContext_->codec_type = AVMEDIA_TYPE_VIDEO;
     pAVCodecContext_->pix_fmt = AV_PIX_FMT_NV12;
+    if (keyframe_only_) {
+        // 非IDR的I帧前面没有参考帧也没有恢复点SEI，不加这个标志解码器会把它当作未恢复的帧不输出
+        pAVCodecContext_->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+    }
 
     // 将上下文和解码器关联
     int ret = avcodec_open2(pAVCodecContext_, pAVCodec_, NULL);
@@ -75,6 +88,26 @@ int FFMPEGDecoder::decode() {
         return -1;
     }
 
+    if (inmap_.open(inputFileName_, true) == 0) {
+        decode_mapped(pkt);
+    } else {
+        decode_file(pkt);
+    }
+    // 冲刷解码器里缓存的帧
+    transcode(pAVCodecContext_, nullptr);
+    inmap_.close();
+
+    av_packet_free(&pkt);
+    if (keyframe_only_) {
+        std::cout << "keyframes: " << keyframe_count_ << ", skipped packets: " << skipped_packets_ << std::endl;
+    }
+    std::cout << "decode done" << std::endl;
+
+    return 0;
+}
+
+// 文件无法映射时（比如管道）用fread分块读取
+int FFMPEGDecoder::decode_file(AVPacket *pkt) {
     // 读取数据并解析
     uint8_t *inbuf     = new uint8_t[VIDEO_INBUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
     uint8_t *data      = inbuf;
@@ -93,7 +126,7 @@ int FFMPEGDecoder::decode() {
         data_size -= ret;
         if (pkt->size) {
             // 解码pkt，并写入文件
-            transcode(pAVCodecContext_, pkt);
+            decode_packet(pkt);
         }
 
         if (data_size < VIDEO_REFILL_THRESH) {
@@ -105,13 +138,462 @@ int FFMPEGDecoder::decode() {
         }
     }
 
-    av_packet_free(&pkt);
     delete[] inbuf;
-    std::cout << "decode done" << std::endl;
+    return 0;
+}
+
+// 直接在映射区上解析，解析出的packet引用映射的页，送入解码器时不再拷贝
+int FFMPEGDecoder::decode_mapped(AVPacket *pkt) {
+    const uint8_t *data      = inmap_.data();
+    size_t         data_size = inmap_.size();
+
+    while (true) {
+        int chunk = data_size > INT_MAX ? INT_MAX : (int)data_size;
+        // data_size为0时让解析器吐出最后缓存的一帧
+        int ret = av_parser_parse2(pParserContext_, pAVCodecContext_, &pkt->data, &pkt->size, data, chunk,
+                                   AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (ret < 0) {
+            fprintf(stderr, "Error while parsing\n");
+            break;
+        }
+        data += ret;
+        data_size -= ret;
+        inmap_.advance(data - inmap_.data());
+
+        if (pkt->size) {
+            // 解析器没有拼接数据时pkt->data就指向映射区
+            if (inmap_.padded(pkt->data, pkt->size)) {
+                pkt->buf = inmap_.ref(pkt->data, pkt->size);
+            }
+            decode_packet(pkt);
+            av_buffer_unref(&pkt->buf);
+        } else if (data_size == 0 && ret == 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int FFMPEGDecoder::decode_parallel(int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    // 队列里和等待解码的GOP最多window个，限制切分出来的码流占用的内存
+    const uint64_t window = (uint64_t)threads * 2;
+
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (codec == nullptr) {
+        std::cout << "find decoder failed" << std::endl;
+        return -1;
+    }
+
+    // 每个线程一个独立的解码上下文，GOP之间没有依赖，上下文内部不再开线程
+    std::vector<AVCodecContext *> contexts;
+    for (int i = 0; i < threads; i++) {
+        AVCodecContext *ctx = avcodec_alloc_context3(codec);
+        if (ctx == nullptr) {
+            std::cout << "avcodec_alloc_context3 failed" << std::endl;
+            break;
+        }
+        ctx->thread_count = 1;
+        if (avcodec_open2(ctx, codec, NULL) < 0) {
+            std::cout << "avcodec_open2 failed" << std::endl;
+            avcodec_free_context(&ctx);
+            break;
+        }
+        contexts.push_back(ctx);
+    }
+    if ((int)contexts.size() != threads) {
+        for (auto &ctx : contexts) {
+            avcodec_free_context(&ctx);
+        }
+        return -1;
+    }
+
+    Utils::BoundedQueue<GopSegment> queue(window);
+
+    // 一个GOP已解码还没写入的帧，done表示这个GOP解码完了
+    struct GopFrames {
+        std::deque<AVFrame *> frames;
+        bool                  done = false;
+    };
+
+    std::mutex                    mutex;
+    std::condition_variable       cond;
+    std::map<uint64_t, GopFrames> reorder;
+    uint64_t                      next_write   = 0;
+    uint64_t                      buffered     = 0; // reorder里所有帧的字节数
+    uint64_t                      peak         = 0;
+    bool                          workers_done = false;
+    std::atomic<bool>             failed(false); // 有GOP解码失败或者写文件失败，输出不完整
+
+    auto frame_bytes = [](const AVFrame *frame) {
+        uint64_t size = 0;
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++) {
+            size += frame->buf[i]->size;
+        }
+        return size;
+    };
+
+    auto worker = [&](AVCodecContext *ctx) {
+        GopSegment segment;
+        while (queue.pop(segment)) {
+            {
+                // 超出窗口的GOP先不解码，等写入线程追上来
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return segment.index < next_write + window; });
+            }
+            auto on_frame = [&](AVFrame *frame) {
+                uint64_t size = frame_bytes(frame);
+                {
+                    // 超出预算时等写入线程腾出空间。正在写的GOP自己没有待写的帧时不等：
+                    // 预算可能被后面的GOP占满，而写入线程只取正在写的GOP，等下去会死锁
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&] {
+                        if (buffered == 0 || buffered + size <= PARALLEL_DECODE_BUFFER_BYTES) {
+                            return true;
+                        }
+                        auto it = reorder.find(segment.index);
+                        return segment.index == next_write && (it == reorder.end() || it->second.frames.empty());
+                    });
+                    reorder[segment.index].frames.push_back(frame);
+                    buffered += size;
+                    peak = buffered > peak ? buffered : peak;
+                }
+                cond.notify_all();
+            };
+            if (decode_gop(ctx, segment, on_frame) < 0) {
+                failed = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                reorder[segment.index].done = true;
+            }
+            cond.notify_all();
+        }
+    };
+
+    // 按GOP序号依次写文件，GOP内部的帧已经是显示顺序；正在写的GOP解码出一帧就写一帧
+    auto writer = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [&] {
+                auto it = reorder.find(next_write);
+                return (it != reorder.end() && (!it->second.frames.empty() || it->second.done)) || workers_done;
+            });
+            auto it = reorder.find(next_write);
+            if (it == reorder.end()) {
+                break;
+            }
+            if (it->second.frames.empty()) {
+                // done且已经写完
+                reorder.erase(it);
+                next_write++;
+                cond.notify_all();
+                continue;
+            }
+            AVFrame *frame = it->second.frames.front();
+            it->second.frames.pop_front();
+            lock.unlock();
+
+            // 写失败也继续取完，不让解码线程卡在预算上
+            uint64_t size = frame_bytes(frame);
+            if (write_yuv(frame) < 0) {
+                failed = true;
+            }
+            av_frame_free(&frame);
+
+            lock.lock();
+            buffered -= size;
+            cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (auto ctx : contexts) {
+        workers.emplace_back(worker, ctx);
+    }
+    std::thread writer_thread(writer);
+
+    int ret = split_gops(queue);
+    queue.close();
 
+    for (auto &t : workers) {
+        t.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers_done = true;
+    }
+    cond.notify_all();
+    writer_thread.join();
+
+    for (auto &ctx : contexts) {
+        avcodec_free_context(&ctx);
+    }
+    inmap_.close();
+    std::cout << "parallel decode done, gops: " << next_write << ", peak buffered: " << (peak >> 20) << " MB"
+              << (failed ? ", output incomplete" : "") << std::endl;
+    return failed ? -1 : ret;
+}
+
+// 从输入文件中查找IDR，把码流切成以IDR（连同它前面的SPS/PPS/SEI/AUD）开头的若干段
+// 文件能映射时每段只引用映射区，否则用fread读到缓冲区再拷贝出来
+int FFMPEGDecoder::split_gops(Utils::BoundedQueue<GopSegment> &queue) {
+    const size_t npos   = (size_t)-1;
+    const bool   mapped = inmap_.open(inputFileName_, true) == 0;
+
+    std::vector<uint8_t> filebuf;
+
+    // 当前段开始之前出现的SPS/PPS（带起始码），按id保存，每个id只留最新的；
+    // 段开始之后出现的先放在pending里，段送出时位置在切点之前的才生效，
+    // 切点之后（下一个IDR前面）的属于下一段
+    struct ParamSet {
+        int                  type = 0;
+        int                  id   = 0;
+        size_t               pos  = 0;
+        std::vector<uint8_t> data;
+    };
+    std::map<int, std::vector<uint8_t>> sps, pps;
+    std::vector<ParamSet>               pending;
+
+    const uint8_t *buf       = mapped ? inmap_.data() : nullptr;
+    size_t         buf_size  = mapped ? inmap_.size() : 0;
+    uint64_t       index     = 0;
+    size_t         seg_begin = 0;    // 当前段在buf中的起始位置
+    size_t         scan      = 0;    // 下一次查找起始码的位置
+    size_t         nal_start = npos; // 上一个NAL起始码的位置
+    int            nal_type  = -1;
+    size_t         au_start  = npos; // 最近的VCL之后第一个非VCL NAL的位置，即下一个访问单元的开头
+    bool           has_vcl   = false;
+    bool           eof       = mapped;
+
+    // 把buf的[seg_begin, cut)作为一个GOP送出
+    auto emit = [&](size_t cut) -> bool {
+        GopSegment segment;
+        segment.index = index++;
+        for (auto &item : sps) {
+            segment.data.insert(segment.data.end(), item.second.begin(), item.second.end());
+        }
+        for (auto &item : pps) {
+            segment.data.insert(segment.data.end(), item.second.begin(), item.second.end());
+        }
+        // 这一段里的参数集对后面的段生效
+        auto later = std::stable_partition(pending.begin(), pending.end(),
+                                           [&](const ParamSet &set) { return set.pos < cut; });
+        for (auto it = pending.begin(); it != later; ++it) {
+            (it->type == 7 ? sps : pps)[it->id] = std::move(it->data);
+        }
+        pending.erase(pending.begin(), later);
+        if (mapped) {
+            segment.view      = buf + seg_begin;
+            segment.view_size = cut - seg_begin;
+            inmap_.advance(cut);
+        } else {
+            segment.data.insert(segment.data.end(), buf + seg_begin, buf + cut);
+        }
+        segment.data.resize(segment.data.size() + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+        seg_begin = cut;
+        has_vcl   = false;
+        return queue.push(std::move(segment));
+    };
+
+    do {
+        if (!mapped) {
+            // 已经送出的数据从缓冲区移除，剩下的位置整体前移
+            filebuf.erase(filebuf.begin(), filebuf.begin() + seg_begin);
+            scan -= seg_begin;
+            if (nal_start != npos) {
+                nal_start -= seg_begin;
+            }
+            if (au_start != npos) {
+                au_start -= seg_begin;
+            }
+            for (auto &set : pending) {
+                set.pos -= seg_begin;
+            }
+            seg_begin = 0;
+
+            size_t old_size = filebuf.size();
+            filebuf.resize(old_size + GOP_READ_CHUNK);
+            size_t len = fread(filebuf.data() + old_size, 1, GOP_READ_CHUNK, infile_);
+            filebuf.resize(old_size + len);
+            if (len == 0) {
+                eof = true;
+            }
+            buf      = filebuf.data();
+            buf_size = filebuf.size();
+        }
+
+        while (true) {
+            size_t i = Utils::findStartCode(buf, buf_size, scan);
+            if (i == buf_size) {
+                // 结尾的两个字节可能是被截断的起始码，下次从这里接着找
+                i = buf_size > scan + 2 ? buf_size - 2 : scan;
+            }
+            // 需要能读到NAL头和slice头的第一个字节，不够就等下一次读文件
+            if (i + 3 >= buf_size || (!eof && i + 5 > buf_size)) {
+                scan = i;
+                break;
+            }
+            size_t sc     = (i > seg_begin && buf[i - 1] == 0) ? i - 1 : i;
+            size_t header = i + 3;
+            scan          = header + 1;
+
+            // 上一个NAL到这里结束，记下参数集
+            if (nal_type == 7 || nal_type == 8) {
+                size_t nal_header = buf[nal_start + 2] == 1 ? nal_start + 3 : nal_start + 4;
+                int    id = H264_BS::MediaDetector::getParameterSetId(buf + nal_header, sc - nal_header);
+                if (id >= 0) {
+                    ParamSet set;
+                    set.type = nal_type;
+                    set.id   = id;
+                    set.pos  = nal_start;
+                    set.data.assign(buf + nal_start, buf + sc);
+                    pending.push_back(std::move(set));
+                }
+            }
+
+            int type = buf[header] & 0x1f;
+            if (type == 6 || type == 7 || type == 8 || type == 9) {
+                if (au_start == npos) {
+                    au_start = sc;
+                }
+            } else if (type >= 1 && type <= 5) {
+                // first_mb_in_slice为0（ue编码为单个1）时是新一帧的第一个slice
+                bool first_slice = header + 1 < buf_size && (buf[header + 1] & 0x80);
+                if (type == 5 && first_slice && has_vcl) {
+                    if (!emit(au_start != npos ? au_start : sc)) {
+                        return -1;
+                    }
+                }
+                has_vcl  = true;
+                au_start = npos;
+            }
+            nal_start = sc;
+            nal_type  = type;
+        }
+    } while (!eof);
+
+    if (has_vcl && !emit(buf_size)) {
+        return -1;
+    }
     return 0;
 }
 
+// 解码一个GOP：解析出完整的帧逐个送入解码器，最后冲刷出所有缓存帧，并重置上下文供下一个GOP使用
+int FFMPEGDecoder::decode_gop(AVCodecContext *codec_ctx, GopSegment &segment,
+                              const std::function<void(AVFrame *)> &on_frame) {
+    AVPacket *pkt = av_packet_alloc();
+    if (pkt == nullptr) {
+        return -1;
+    }
+
+    // 出错的帧不中断这个GOP，能解的继续解，最后返回-1
+    int result = 0;
+
+    auto receive = [&]() {
+        while (true) {
+            AVFrame *frame = av_frame_alloc();
+            int      ret   = frame ? avcodec_receive_frame(codec_ctx, frame) : AVERROR(ENOMEM);
+            if (ret < 0) {
+                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                    std::cout << "gop " << segment.index << " receive frame failed, " << av_get_err(ret) << std::endl;
+                    result = -1;
+                }
+                av_frame_free(&frame);
+                break;
+            }
+            on_frame(frame);
+        }
+    };
+
+    auto send = [&]() {
+        // 访问单元在映射区里时直接引用，不拷贝
+        if (inmap_.padded(pkt->data, pkt->size)) {
+            pkt->buf = inmap_.ref(pkt->data, pkt->size);
+        }
+        int ret = avcodec_send_packet(codec_ctx, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            receive();
+            ret = avcodec_send_packet(codec_ctx, pkt);
+        }
+        if (ret < 0) {
+            std::cout << "gop " << segment.index << " send packet failed, " << av_get_err(ret) << std::endl;
+            result = -1;
+        }
+        av_buffer_unref(&pkt->buf);
+        receive();
+    };
+
+    /**
+     * 直接按NAL切出访问单元，不经过av_parser：AUD/SPS/PPS/SEI或者新一帧的第一个slice
+     * 出现在slice之后，说明上一帧结束了；没有slice的部分（补上的参数集）单独作为一个packet
+     */
+    auto parse = [&](const uint8_t *data, size_t data_size) {
+        const uint8_t *au_start = nullptr;
+        bool           has_vcl  = false;
+
+        auto emit = [&](const uint8_t *au_end) {
+            if (au_start && au_end > au_start) {
+                pkt->data = (uint8_t *)au_start;
+                pkt->size = (int)(au_end - au_start);
+                send();
+            }
+            au_start = au_end;
+            has_vcl  = false;
+        };
+
+        Utils::NalIterator<Utils::NalFraming::ANNEXB> it(data, data_size);
+        Utils::NalUnit                                nal;
+        while (it.next(nal)) {
+            const uint8_t *sc    = nal.data - nal.prefix;
+            int            type  = H264_BS::MediaDetector::getNalType(nal.data);
+            bool           slice = H264_BS::MediaDetector::isSlice(type);
+            if (au_start == nullptr) {
+                au_start = sc;
+            } else if (has_vcl && (H264_BS::MediaDetector::startsAccessUnit(type) ||
+                                   (slice && H264_BS::MediaDetector::isFirstSlice(nal.data, nal.size)))) {
+                emit(sc);
+            }
+            has_vcl = has_vcl || slice;
+        }
+        emit(data + data_size);
+    };
+
+    // data里是补上的参数集（或者拷贝出来的整段数据），view是映射区里的这一段
+    parse(segment.data.data(), segment.data.size() - AV_INPUT_BUFFER_PADDING_SIZE);
+    parse(segment.view, segment.view_size);
+
+    avcodec_send_packet(codec_ctx, nullptr);
+    receive();
+    avcodec_flush_buffers(codec_ctx);
+
+    av_packet_free(&pkt);
+    return result;
+}
+
+void FFMPEGDecoder::set_keyframe_only(bool enable) {
+    keyframe_only_ = enable;
+}
+
+// 关键帧模式下解析器输出的每个访问单元先判断帧类型，只有IDR/I帧送进解码器，
+// 送完立即冲刷出这一帧并复位解码器，下一个关键帧不依赖之前的任何状态
+int FFMPEGDecoder::decode_packet(AVPacket *pkt) {
+    if (!keyframe_only_) {
+        return transcode(pAVCodecContext_, pkt);
+    }
+    if (!H264_BS::MediaDetector::isKeyFrame(pkt->data, pkt->size)) {
+        skipped_packets_++;
+        return 0;
+    }
+    keyframe_count_++;
+    int ret = transcode(pAVCodecContext_, pkt);
+    transcode(pAVCodecContext_, nullptr);
+    avcodec_flush_buffers(pAVCodecContext_);
+    return ret;
+}
+
 // AVPacket转换到AVFrame，并写入文件
 int FFMPEGDecoder::transcode(AVCodecContext *codec_ctx, AVPacket *pkt) {
 
@@ -149,18 +631,14 @@ int FFMPEGDecoder::transcode(AVCodecContext *codec_ctx, AVPacket *pkt) {
     return 0;
 }
 
+// 帧交给写线程，按行拷贝和写文件都不在解码线程里做
 int FFMPEGDecoder::write_yuv(AVFrame *frame) {
-    for (int j = 0; j < frame->height; j++)
-        fwrite(frame->data[0] + j * frame->linesize[0], 1, frame->width, outfile_);
-    for (int j = 0; j < frame->height / 2; j++)
-        fwrite(frame->data[1] + j * frame->linesize[1], 1, frame->width / 2, outfile_);
-    for (int j = 0; j < frame->height / 2; j++)
-        fwrite(frame->data[2] + j * frame->linesize[2], 1, frame->width / 2, outfile_);
-    return 0;
+    return writer_.write(frame);
 }
 
 
-int FFMPEGDecoder::init_inAndout_file(std::string &input, std::string &output) {
+int FFMPEGDecoder::init_inAndout_file(std::string &input, std::string &output, AVPixelFormat out_format,
+                                      bool direct_io) {
     inputFileName_  = input;
     outputFileName_ = output;
 
@@ -169,9 +647,7 @@ int FFMPEGDecoder::init_inAndout_file(std::string &input, std::string &output) {
         std::cout << "inputfile open failed: " << inputFileName_ << std::endl;
         return -1;
     }
-    outfile_ = fopen(outputFileName_.c_str(), "wb");
-    if (outfile_ == nullptr) {
-        std::cout << "outputfile open failed: " << outputFileName_ << std::endl;
+    if (writer_.open(outputFileName_, out_format, direct_io) < 0) {
         return -1;
     }
     return 0;
@@ -181,8 +657,6 @@ int FFMPEGDecoder::deinit_inAndout_file() {
     if (infile_) {
         fclose(infile_);
     }
-    if (outfile_) {
-        fclose(outfile_);
-    }
+    writer_.close();
     return 0;
 }
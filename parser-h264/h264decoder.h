@@ -6,13 +6,26 @@ extern "C" {
 #include <libavutil/log.h>
 #include <libswscale/swscale.h>
 }
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "h264bs.hpp"
+#include "mapped_file.hpp"
+#include "yuv-writer.h"
+
+// 并行解码时重排缓冲的上限（字节），一帧4K NV12约12MB
+#define PARALLEL_DECODE_BUFFER_BYTES (512ULL << 20)
 
 //H264文件解码成YUV420P并写入文件
 
 class FFMPEGDecoder {
 public:
-    FFMPEGDecoder(std::string in, std::string out);
+    // out_format为AV_PIX_FMT_NONE时按解码输出格式写YUV，direct_io使用O_DIRECT写文件
+    FFMPEGDecoder(std::string in, std::string out, AVPixelFormat out_format = AV_PIX_FMT_NONE,
+                  bool direct_io = false);
     ~FFMPEGDecoder();
 
     int init_decoder();
@@ -20,11 +33,36 @@ public:
 
     int decode();
 
+    // 只解码IDR/I帧（缩略图、时间轴预览），其余帧在送入解码器之前丢掉；需在init_decoder之前设置
+    void set_keyframe_only(bool enable);
+
+    // 离线导出用：按IDR把文件切分成GOP，threads个独立的解码上下文并行解码，
+    // 解码结果经重排缓冲按显示顺序写入文件。正在写的GOP边解码边写，
+    // 其余GOP已解码未写入的帧总大小不超过PARALLEL_DECODE_BUFFER_BYTES
+    int decode_parallel(int threads);
+
 private:
+    // 以IDR开头的一段码流，data里补上这一段开始之前出现过的SPS/PPS（每个id最新的一个）；
+    // 输入文件映射成功时码流本身只是映射区的一段view，否则拷贝在data里
+    struct GopSegment {
+        uint64_t             index = 0;
+        std::vector<uint8_t> data;
+        const uint8_t       *view      = nullptr;
+        size_t               view_size = 0;
+    };
+
+    int split_gops(Utils::BoundedQueue<GopSegment> &queue);
+    // 每解码出一帧调用一次on_frame，帧的所有权交给on_frame
+    int decode_gop(AVCodecContext *codec_ctx, GopSegment &segment, const std::function<void(AVFrame *)> &on_frame);
+
+    int decode_file(AVPacket *pkt);
+    int decode_mapped(AVPacket *pkt);
+
+    int decode_packet(AVPacket *pkt);
     int transcode(AVCodecContext *codec_ctx, AVPacket *pkt);
     int write_yuv(AVFrame *frame);
 
-    int init_inAndout_file(std::string &input, std::string &output);
+    int init_inAndout_file(std::string &input, std::string &output, AVPixelFormat out_format, bool direct_io);
     int deinit_inAndout_file();
 
 private:
@@ -36,8 +74,15 @@ private:
     std::string inputFileName_  = "test.h264";
     std::string outputFileName_ = "test.yuv";
 
-    FILE *infile_  = nullptr;
-    FILE *outfile_ = nullptr;
+    FILE     *infile_ = nullptr;
+    YuvWriter writer_;
+
+    // 输入文件的内存映射，映射失败时回退到infile_
+    Utils::MappedFile inmap_;
+
+    bool     keyframe_only_   = false;
+    uint64_t keyframe_count_  = 0;
+    uint64_t skipped_packets_ = 0;
 };
 
 //  ffplay -pixel_format yuv420p -video_size 768x320 -framerate 25 out.yuv
@@ -0,0 +1,128 @@
+#include "rate-filter.h"
+
+#include "h264bs.hpp"
+
+using H264_BS::MediaDetector;
+
+RateFilter::RateFilter() {}
+
+RateFilter::~RateFilter() {
+    av_packet_free(&held_);
+    av_packet_free(&ready_);
+}
+
+int RateFilter::init(int nal_length_size, bool drop_non_ref, int max_temporal_id) {
+    if (nal_length_size < 0 || nal_length_size > 4) {
+        return -1;
+    }
+    nal_length_size_ = nal_length_size;
+    drop_non_ref_    = drop_non_ref;
+    max_temporal_id_ = max_temporal_id;
+
+    if (held_ == nullptr) {
+        held_ = av_packet_alloc();
+    }
+    if (ready_ == nullptr) {
+        ready_ = av_packet_alloc();
+    }
+    if (held_ == nullptr || ready_ == nullptr) {
+        return -1;
+    }
+    av_packet_unref(held_);
+    av_packet_unref(ready_);
+    has_held_         = false;
+    has_ready_        = false;
+    eof_              = false;
+    dropped_duration_ = 0;
+    stats_            = Stats();
+    return 0;
+}
+
+bool RateFilter::keep(const uint8_t *data, size_t size) const {
+    bool reference   = false;
+    bool has_slice   = false;
+    int  temporal_id = 0;
+
+    MediaDetector::forEachNal(data, size, nal_length_size_, [&](const unsigned char *nal, size_t nal_size) {
+        int type = MediaDetector::getNalType(nal);
+        if ((type == 14 || type == 20) && nal_size >= 4) {
+            // nal_unit_header_svc_extension的第三个字节高3位为temporal_id
+            int tid     = nal[3] >> 5;
+            temporal_id = tid > temporal_id ? tid : temporal_id;
+        }
+        if (MediaDetector::isSlice(type)) {
+            has_slice = true;
+            // nal_ref_idc，同一帧的所有slice应该一致，有一个不为0就当参考帧
+            reference = reference || (nal[0] & 0x60) != 0;
+        }
+        return true;
+    });
+
+    // 没有slice的packet（只有参数集/SEI等）原样保留
+    if (!has_slice) {
+        return true;
+    }
+    if (drop_non_ref_ && !reference) {
+        return false;
+    }
+    if (max_temporal_id_ >= 0 && temporal_id > max_temporal_id_) {
+        return false;
+    }
+    return true;
+}
+
+int RateFilter::send_packet(AVPacket *pkt) {
+    if (held_ == nullptr || eof_) {
+        return AVERROR(EINVAL);
+    }
+    if (has_ready_) {
+        return AVERROR(EAGAIN);
+    }
+
+    if (pkt == nullptr) {
+        eof_ = true;
+        return release(AV_NOPTS_VALUE);
+    }
+
+    stats_.in++;
+    if (!keep(pkt->data, pkt->size)) {
+        stats_.dropped++;
+        dropped_duration_ += pkt->duration;
+        av_packet_unref(pkt);
+        return 0;
+    }
+
+    release(pkt->dts);
+    av_packet_move_ref(held_, pkt);
+    has_held_ = true;
+    return 0;
+}
+
+int RateFilter::receive_packet(AVPacket *pkt) {
+    if (has_ready_) {
+        av_packet_move_ref(pkt, ready_);
+        has_ready_ = false;
+        stats_.out++;
+        return 0;
+    }
+    return eof_ ? AVERROR_EOF : AVERROR(EAGAIN);
+}
+
+// 下一个保留帧到来时held_的时长才确定：有dts时直接取差值，否则把中间丢掉的帧的时长补上
+int RateFilter::release(int64_t next_dts) {
+    if (!has_held_) {
+        dropped_duration_ = 0;
+        return 0;
+    }
+    if (next_dts != AV_NOPTS_VALUE && held_->dts != AV_NOPTS_VALUE && next_dts > held_->dts) {
+        held_->duration = next_dts - held_->dts;
+    } else {
+        held_->duration += dropped_duration_;
+    }
+    dropped_duration_ = 0;
+
+    av_packet_move_ref(ready_, held_);
+    has_held_  = false;
+    has_ready_ = true;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+
+/**
+ * @brief 码流级降帧率，不解码不编码，只丢packet
+ * 丢掉不被参考的帧（所有slice的nal_ref_idc为0），或者按SVC prefix NAL(14)/NAL 20里的
+ * temporal_id丢掉高时域层；保留下来的packet延后一个输出，时长改为到下一个保留帧为止
+ */
+class RateFilter {
+public:
+    struct Stats {
+        uint64_t in      = 0;
+        uint64_t out     = 0;
+        uint64_t dropped = 0;
+    };
+
+    RateFilter();
+    ~RateFilter();
+
+    RateFilter(const RateFilter &) = delete;
+
+    /**
+     * @param nal_length_size 0为Annex-B，否则为AVCC里NAL长度字段的字节数
+     * @param drop_non_ref    丢弃nal_ref_idc为0的帧
+     * @param max_temporal_id 只保留temporal_id不大于它的层，小于0时不按时域层丢
+     */
+    int init(int nal_length_size, bool drop_non_ref, int max_temporal_id = -1);
+
+    // pkt为nullptr表示输入结束；packet的引用被filter接管
+    int send_packet(AVPacket *pkt);
+
+    // 返回0表示取到一个packet，AVERROR(EAGAIN)需要继续送入，AVERROR_EOF已经全部取完
+    int receive_packet(AVPacket *pkt);
+
+    // 一个访问单元是否保留
+    bool keep(const uint8_t *data, size_t size) const;
+
+    const Stats &stats() const {
+        return stats_;
+    }
+
+private:
+    int release(int64_t next_dts);
+
+private:
+    int  nal_length_size_ = 0;
+    bool drop_non_ref_    = true;
+    int  max_temporal_id_ = -1;
+
+    // 等下一个保留帧确定时长的packet，和已经可以输出的packet
+    AVPacket *held_      = nullptr;
+    AVPacket *ready_     = nullptr;
+    bool      has_held_  = false;
+    bool      has_ready_ = false;
+    bool      eof_       = false;
+
+    // held_之后被丢掉的packet的时长之和，没有dts时用来补到held_上
+    int64_t dropped_duration_ = 0;
+
+    Stats stats_;
+};
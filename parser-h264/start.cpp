@@ -16,14 +16,25 @@ extern "C" {
 
 int main(int argc, char *argv[]) {
 
-    if (argc < 2) {
-        std::cout << argv[0] << " intputfile outputfile" << std::endl;
+    if (argc < 3) {
+        std::cout << argv[0] << " intputfile outputfile [png_compression 0~9] [png_pred none|sub|up|avg|paeth|mixed]"
+                  << std::endl;
+        std::cout << "outputfile with %d, e.g. out_%05d.png, writes one png per frame" << std::endl;
         return -1;
     }
 
     SWTranscoder transcoder_;
     int          ret = transcoder_.open(AV_CODEC_ID_H264, AV_CODEC_ID_PNG);
 
+    Utils::ImageExporter::Options options;
+    if (argc > 3) {
+        options.png_compression = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        options.png_pred = argv[4];
+    }
+    transcoder_.set_image_options(options);
+
     if (ret == 0) {
         transcoder_.transcode(argv[1], argv[2]);
     }
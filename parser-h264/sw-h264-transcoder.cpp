@@ -5,11 +5,17 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include "bounded_queue.hpp"
+#include "h264bs.hpp"
+
+#include <atomic>
 #include <cstdio>
 #include <iostream>
+#include <thread>
 
-#define VIDEO_INBUF_SIZE    200000
-#define VIDEO_REFILL_THRESH 4096
+#define VIDEO_INBUF_SIZE       200000
+#define VIDEO_REFILL_THRESH    4096
+#define TRANSCODE_QUEUE_FRAMES 8
 
 static char errStr[1024];
 
@@ -53,45 +59,129 @@ int SWTranscoder::transcode(std::string infile, std::string outfile) {
         return -1;
     }
 
+    if (out_codec_id_ == AV_CODEC_ID_PNG || out_codec_id_ == AV_CODEC_ID_MJPEG) {
+        ret = transcode_images(outfile);
+        close_format();
+        return ret;
+    }
+
     FILE *pOutFile = fopen(outfile.c_str(), "w");
     if (pOutFile == nullptr) {
         std::cout << outfile << " open failed" << std::endl;
         return -1;
     }
 
+    auto write_packet = [&](unsigned int frameid, AVPacket *outpkt) {
+        (void)frameid;
+        fwrite(outpkt->data, 1, outpkt->size, pOutFile);
+    };
+
+    // 解码和编码分在两个线程，中间用有界队列传帧，编码器在整个流里只打开一次
+    Utils::BoundedQueue<AVFrame *> frames(TRANSCODE_QUEUE_FRAMES);
+    std::atomic<bool>              encode_failed(false);
+
+    std::thread encode_thread([&]() {
+        AVFrame     *frame   = nullptr;
+        unsigned int frameid = 0;
+        while (frames.pop(frame)) {
+            if (!encoder_opened_ && !encode_failed &&
+                open_encoder(out_codec_id_, (AVPixelFormat)frame->format, frame->width, frame->height) < 0) {
+                // 打开失败只试一次：关掉队列让解码停下来，剩下的帧丢掉
+                encode_failed = true;
+                frames.close();
+            }
+            if (encoder_opened_) {
+                do_encode(frameid, frame, write_packet);
+            }
+            av_frame_free(&frame);
+            frameid++;
+        }
+        // 冲刷编码器
+        if (encoder_opened_) {
+            do_encode(frameid, nullptr, write_packet);
+        }
+    });
+
+    auto push_frame = [&](unsigned int pktid, AVFrame *frame) {
+        (void)pktid;
+        AVFrame *ref = av_frame_clone(frame);
+        if (ref && !frames.push(ref)) {
+            av_frame_free(&ref);
+        }
+    };
+
     AVPacket    *pkt      = av_packet_alloc();
     unsigned int pktCount = 0;
 
-    while (av_read_frame(pFormat_ctx_, pkt) >= 0) {
-
+    while (!encode_failed && av_read_frame(pFormat_ctx_, pkt) >= 0) {
         if (pkt->size && pkt->stream_index == video_index_) {
-            do_decode(pktCount, pkt, [&](unsigned int pktid, AVFrame *frame) {
-                std::cout << "decode callback " << pktid << std::endl;
+            decode_packet(pktCount, pkt, push_frame);
+        }
+        av_packet_unref(pkt);
+        pktCount++;
+    }
 
-                if (!encoder_opened_) {
-                    open_encoder(out_codec_id_, (AVPixelFormat)frame->format, pDecodec_ctx_->width,
-                                 pDecodec_ctx_->height);
-                }
+    // 冲刷解码器，再通知编码线程结束
+    if (!encode_failed) {
+        do_decode(pktCount, nullptr, push_frame);
+    }
+    avcodec_flush_buffers(pDecodec_ctx_);
+    frames.close();
+    encode_thread.join();
+    close_encoder();
+    close_format();
 
-                if (encoder_opened_) {
-                    do_encode(pktid, frame, [&](unsigned int frameid, AVPacket *outpkt) {
-                        std::cout << "encode callback " << frameid << std::endl;
-                        fwrite(outpkt->data, 1, outpkt->size, pOutFile);
-                    });
-                }
-            });
-        }
-        if (encoder_opened_) {
-            close_encoder();
+    av_packet_free(&pkt);
+    fclose(pOutFile);
+    return encode_failed ? -1 : 0;
+}
+
+void SWTranscoder::set_image_options(const Utils::ImageExporter::Options &options) {
+    image_options_ = options;
+}
+
+// 帧内编码的图片之间没有依赖，解码线程只负责把帧交给导出线程池
+int SWTranscoder::transcode_images(std::string outfile) {
+    Utils::ImageExporter::Options options = image_options_;
+    options.codec                         = out_codec_id_;
+    options.output                        = outfile;
+
+    Utils::ImageExporter exporter;
+    if (exporter.open(options) < 0) {
+        return -1;
+    }
+
+    auto export_frame = [&](unsigned int pktid, AVFrame *frame) {
+        (void)pktid;
+        exporter.write(frame);
+    };
+
+    AVPacket    *pkt      = av_packet_alloc();
+    unsigned int pktCount = 0;
+
+    while (av_read_frame(pFormat_ctx_, pkt) >= 0) {
+        if (pkt->size && pkt->stream_index == video_index_) {
+            decode_packet(pktCount, pkt, export_frame);
         }
+        av_packet_unref(pkt);
         pktCount++;
     }
 
+    do_decode(pktCount, nullptr, export_frame);
+    avcodec_flush_buffers(pDecodec_ctx_);
     av_packet_free(&pkt);
-    fclose(pOutFile);
+
+    if (exporter.close() < 0) {
+        std::cout << "image export failed" << std::endl;
+        return -1;
+    }
     return 0;
 }
 
+void SWTranscoder::set_keyframe_only(bool enable) {
+    keyframe_only_ = enable;
+}
+
 int SWTranscoder::close() {
     close_encoder();
     close_format();
@@ -118,6 +208,10 @@ int SWTranscoder::open_decoder(AVCodecID codecID, AVPixelFormat outPixel) {
     // todo 设置像素格式没有作用
     pDecodec_ctx_->pix_fmt    = outPixel;
     pDecodec_ctx_->sw_pix_fmt = outPixel;
+    if (keyframe_only_) {
+        // 非IDR的I帧没有恢复点，不加这个标志解码器不会输出
+        pDecodec_ctx_->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+    }
     // pDecodec_ctx_->get_format = get_format;
 
     int ret = avcodec_open2(pDecodec_ctx_, pDecodec_, NULL);
@@ -165,6 +259,20 @@ int SWTranscoder::do_decode(unsigned int pktid, AVPacket *inpkt, DecodeCallback
     return 0;
 }
 
+// 关键帧模式下非关键帧不送进解码器；关键帧送完立即冲刷并复位，下一个关键帧单独解码
+int SWTranscoder::decode_packet(unsigned int pktid, AVPacket *inpkt, DecodeCallback callback) {
+    if (!keyframe_only_) {
+        return do_decode(pktid, inpkt, callback);
+    }
+    if (!H264_BS::MediaDetector::isKeyFrame(inpkt->data, inpkt->size, nal_length_size_, nal_codec_)) {
+        return 0;
+    }
+    int ret = do_decode(pktid, inpkt, callback);
+    do_decode(pktid, nullptr, callback);
+    avcodec_flush_buffers(pDecodec_ctx_);
+    return ret;
+}
+
 // encoder
 int SWTranscoder::open_encoder(AVCodecID codecID, AVPixelFormat inPixel, int width, int height) {
     pEncodec_ = avcodec_find_encoder(codecID);
@@ -191,6 +299,7 @@ int SWTranscoder::open_encoder(AVCodecID codecID, AVPixelFormat inPixel, int wid
     if (ret < 0) {
         av_strerror(ret, errStr, sizeof(errStr));
         std::cout << "encoder open failed, " << errStr << std::endl;
+        avcodec_free_context(&pEncodec_ctx_);
         return -1;
     }
     encoder_opened_ = true;
@@ -262,6 +371,17 @@ int SWTranscoder::open_format(std::string filename) {
             std::cout << "find best video stream failed, " << errStr << std::endl;
             break;
         } else {
+            // avcC: extradata[0]为1，extradata[4]低两位为NAL长度字段字节数减1；hvcC在extradata[21]
+            AVCodecParameters *par = pFormat_ctx_->streams[video_index_]->codecpar;
+            nal_length_size_       = 0;
+            nal_codec_ = par->codec_id == AV_CODEC_ID_HEVC ? H264_BS::CODEC_H265 : H264_BS::CODEC_H264;
+            if (nal_codec_ == H264_BS::CODEC_H265) {
+                if (par->extradata_size >= 23 && par->extradata[0] == 1) {
+                    nal_length_size_ = (par->extradata[21] & 0x03) + 1;
+                }
+            } else if (par->extradata_size >= 7 && par->extradata[0] == 1) {
+                nal_length_size_ = (par->extradata[4] & 0x03) + 1;
+            }
             return 0;
         }
 
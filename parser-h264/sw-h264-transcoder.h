@@ -9,6 +9,9 @@ extern "C" {
 #include <functional>
 #include <memory>
 
+#include "h264bs.hpp"
+#include "image_exporter.hpp"
+
 /**
  * @brief 转码视频裸流文件
  * 
@@ -24,8 +27,18 @@ public:
 
     int open(AVCodecID inCodecID, AVCodecID outCodecID);
 
+    /**
+     * @brief 输出PNG/MJPEG时每帧独立编码，由ImageExporter分给多个线程
+     * outfile含%d（如out_%05d.png）时每帧一个文件，否则按顺序拼接到outfile
+     */
     int transcode(std::string infile, std::string outfile);
 
+    // 图片导出的线程数和PNG压缩等级、预测滤波，codec和output由open/transcode决定
+    void set_image_options(const Utils::ImageExporter::Options &options);
+
+    // 只解码IDR/I帧，用于缩略图和时间轴预览；需在open之前设置
+    void set_keyframe_only(bool enable);
+
     int close();
 
 private:
@@ -33,11 +46,14 @@ private:
     int open_encoder(AVCodecID codecID, AVPixelFormat inPixel, int width, int height);
 
     int do_decode(unsigned int pktid, AVPacket *inpkt, DecodeCallback callback);
+    int decode_packet(unsigned int pktid, AVPacket *inpkt, DecodeCallback callback);
     int do_encode(unsigned int frameid, AVFrame *inframe, EncodeCallback callback);
 
     int close_decoder();
     int close_encoder();
 
+    int transcode_images(std::string outfile);
+
     int open_format(std::string filename);
     int close_format();
 
@@ -52,6 +68,12 @@ private:
 
     AVFormatContext *pFormat_ctx_ = nullptr;
     int video_index_ = -1;
+    // 输入为AVCC格式（mp4等）时NAL长度字段的字节数，Annex-B为0
+    int nal_length_size_ = 0;
+    // 关键帧判断按输入流的编码格式解析NAL
+    H264_BS::CodecType nal_codec_ = H264_BS::CODEC_H264;
+
+    bool keyframe_only_ = false;
 
     // 中转的像素格式，但目前没起作用
     const AVPixelFormat transit_pixel_ = AV_PIX_FMT_YUV420P;
@@ -59,5 +81,7 @@ private:
     bool encoder_opened_ = false;
     AVCodecID out_codec_id_ = AV_CODEC_ID_NONE;
 
+    Utils::ImageExporter::Options image_options_;
+
     struct SwsContext *img_convert_ctx_;
 };
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "yuv-writer.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "pixfmt_kernels.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#define STAGING_ALIGN   4096
+#define STAGING_MIN_LEN (16 << 20)
+
+YuvWriter::YuvWriter() {}
+
+YuvWriter::~YuvWriter() {
+    close();
+}
+
+bool YuvWriter::supported(AVPixelFormat format) {
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_P010LE:
+    case AV_PIX_FMT_YUV422P:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int YuvWriter::open(const std::string &filename, AVPixelFormat out_format, bool direct_io, int queue_frames) {
+    close();
+
+    if (out_format != AV_PIX_FMT_NONE && !supported(out_format)) {
+        std::cout << "unsupported yuv output format: " << av_get_pix_fmt_name(out_format) << std::endl;
+        return -1;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (direct_io) {
+        fd_ = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+        if (fd_ < 0) {
+            // tmpfs等文件系统不支持O_DIRECT
+            std::cout << "open with O_DIRECT failed, fallback to buffered io: " << filename << std::endl;
+        }
+    }
+    if (fd_ < 0) {
+        direct_io = false;
+        fd_       = ::open(filename.c_str(), flags, 0644);
+    }
+    if (fd_ < 0) {
+        std::cout << "outputfile open failed: " << filename << std::endl;
+        return -1;
+    }
+
+    direct_io_    = direct_io;
+    out_format_   = out_format;
+    error_        = 0;
+    staging_used_ = 0;
+    queue_.reset(new Utils::BoundedQueue<AVFrame *>(queue_frames > 0 ? queue_frames : 1));
+    thread_ = std::thread(&YuvWriter::writer_loop, this);
+    return 0;
+}
+
+int YuvWriter::write(const AVFrame *frame) {
+    if (!queue_ || frame == nullptr) {
+        return -1;
+    }
+    // 只增加引用，不拷贝数据
+    AVFrame *ref = av_frame_clone(frame);
+    if (ref == nullptr) {
+        return -1;
+    }
+    if (!queue_->push(ref)) {
+        av_frame_free(&ref);
+        return -1;
+    }
+    return error_;
+}
+
+int YuvWriter::close() {
+    if (queue_) {
+        queue_->close();
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    queue_.reset();
+
+    if (fd_ >= 0) {
+        flush_staging(true);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    free(staging_);
+    staging_      = nullptr;
+    staging_size_ = 0;
+    staging_used_ = 0;
+
+    sws_freeContext(sws_ctx_);
+    sws_ctx_ = nullptr;
+    av_frame_free(&converted_);
+    return error_;
+}
+
+void YuvWriter::writer_loop() {
+    AVFrame *frame = nullptr;
+    while (queue_->pop(frame)) {
+        const AVFrame *out = convert(frame);
+        if (out == nullptr || pack(out) < 0) {
+            error_ = -1;
+        }
+        av_frame_free(&frame);
+    }
+}
+
+// 常见的格式对直接用SIMD内核转换，比swscale快，返回false时交给swscale
+static bool convert_kernel(const AVFrame *src, AVFrame *dst) {
+    using namespace Utils::PixFmt;
+    AVPixelFormat         in  = (AVPixelFormat)src->format;
+    AVPixelFormat         out = (AVPixelFormat)dst->format;
+    const uint8_t *const *s   = src->data;
+    const int            *sl  = src->linesize;
+    uint8_t *const       *d   = dst->data;
+    const int            *dl  = dst->linesize;
+    int                   w   = src->width;
+    int                   h   = src->height;
+
+    if (in == AV_PIX_FMT_YUV420P && out == AV_PIX_FMT_NV12) {
+        i420ToNv12(s[0], sl[0], s[1], sl[1], s[2], sl[2], d[0], dl[0], d[1], dl[1], w, h);
+    } else if (in == AV_PIX_FMT_NV12 && out == AV_PIX_FMT_YUV420P) {
+        nv12ToI420(s[0], sl[0], s[1], sl[1], d[0], dl[0], d[1], dl[1], d[2], dl[2], w, h);
+    } else if (in == AV_PIX_FMT_YUV420P10LE && out == AV_PIX_FMT_P010LE) {
+        i010ToP010(s[0], sl[0], s[1], sl[1], s[2], sl[2], d[0], dl[0], d[1], dl[1], w, h);
+    } else if (in == AV_PIX_FMT_YUYV422 && out == AV_PIX_FMT_YUV420P && w % 2 == 0) {
+        yuyvToI420(s[0], sl[0], d[0], dl[0], d[1], dl[1], d[2], dl[2], w, h);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const AVFrame *YuvWriter::convert(const AVFrame *frame) {
+    if (out_format_ == AV_PIX_FMT_NONE || frame->format == out_format_) {
+        return frame;
+    }
+
+    if (converted_ == nullptr || converted_->width != frame->width || converted_->height != frame->height) {
+        av_frame_free(&converted_);
+        converted_         = av_frame_alloc();
+        converted_->width  = frame->width;
+        converted_->height = frame->height;
+        converted_->format = out_format_;
+        if (av_frame_get_buffer(converted_, 0) < 0) {
+            av_frame_free(&converted_);
+            return nullptr;
+        }
+    }
+    if (convert_kernel(frame, converted_)) {
+        return converted_;
+    }
+
+    sws_ctx_ = sws_getCachedContext(sws_ctx_, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                    frame->width, frame->height, out_format_, SWS_POINT, NULL, NULL, NULL);
+    if (sws_ctx_ == nullptr) {
+        std::cout << "sws_getCachedContext failed" << std::endl;
+        return nullptr;
+    }
+
+    sws_scale(sws_ctx_, frame->data, frame->linesize, 0, frame->height, converted_->data, converted_->linesize);
+    return converted_;
+}
+
+// 把一帧各平面的有效数据按行紧密排列拷贝到暂存区
+int YuvWriter::pack(const AVFrame *frame) {
+    AVPixelFormat             format = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor *desc   = av_pix_fmt_desc_get(format);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return -1;
+    }
+
+    int    planes = av_pix_fmt_count_planes(format);
+    int    row_bytes[4];
+    int    rows[4];
+    size_t frame_bytes = 0;
+    for (int p = 0; p < planes; p++) {
+        row_bytes[p] = av_image_get_linesize(format, frame->width, p);
+        rows[p]      = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        if (row_bytes[p] < 0) {
+            return -1;
+        }
+        frame_bytes += (size_t)row_bytes[p] * rows[p];
+    }
+
+    if (staging_size_ < frame_bytes + STAGING_ALIGN) {
+        if (flush_staging(false) < 0) {
+            return -1;
+        }
+        size_t size = frame_bytes * 2 + STAGING_ALIGN;
+        size        = size < STAGING_MIN_LEN ? STAGING_MIN_LEN : size;
+        size        = (size + STAGING_ALIGN - 1) / STAGING_ALIGN * STAGING_ALIGN;
+        void *buf   = nullptr;
+        if (posix_memalign(&buf, STAGING_ALIGN, size) != 0) {
+            return -1;
+        }
+        if (staging_used_) {
+            memcpy(buf, staging_, staging_used_);
+        }
+        free(staging_);
+        staging_      = (uint8_t *)buf;
+        staging_size_ = size;
+    }
+    if (staging_used_ + frame_bytes > staging_size_ && flush_staging(false) < 0) {
+        return -1;
+    }
+
+    uint8_t *dst = staging_ + staging_used_;
+    for (int p = 0; p < planes; p++) {
+        const uint8_t *src = frame->data[p];
+        if (frame->linesize[p] == row_bytes[p]) {
+            memcpy(dst, src, (size_t)row_bytes[p] * rows[p]);
+            dst += (size_t)row_bytes[p] * rows[p];
+            continue;
+        }
+        for (int j = 0; j < rows[p]; j++) {
+            memcpy(dst, src, row_bytes[p]);
+            dst += row_bytes[p];
+            src += frame->linesize[p];
+        }
+    }
+    staging_used_ += frame_bytes;
+    return 0;
+}
+
+// O_DIRECT要求长度和文件偏移都按块对齐，不足一块的尾巴留在暂存区里，final时关掉O_DIRECT再写
+int YuvWriter::flush_staging(bool final) {
+    if (staging_used_ == 0) {
+        return 0;
+    }
+
+    size_t len = staging_used_;
+    if (direct_io_ && !final) {
+        len = len / STAGING_ALIGN * STAGING_ALIGN;
+    } else if (direct_io_ && final) {
+        int flags = fcntl(fd_, F_GETFL);
+        fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::write(fd_, staging_ + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cout << "write yuv failed, " << strerror(errno) << std::endl;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+
+    staging_used_ -= len;
+    if (staging_used_) {
+        memmove(staging_, staging_ + len, staging_used_);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "bounded_queue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+/**
+ * @brief 把AVFrame写成裸YUV文件
+ * 帧只在调用线程里增加引用，平面数据的拷贝和写文件都在写线程里做；
+ * 每一帧的各个平面按行打包到对齐的大块暂存区，暂存区满了才调用一次write，
+ * 可选O_DIRECT绕过页缓存。支持输出I420、NV12、P010、YUV422P，输入格式不同时用swscale转换
+ */
+class YuvWriter {
+public:
+    YuvWriter();
+    ~YuvWriter();
+
+    YuvWriter(const YuvWriter &) = delete;
+
+    // out_format为AV_PIX_FMT_NONE时按解码输出的格式原样写
+    int open(const std::string &filename, AVPixelFormat out_format = AV_PIX_FMT_NONE, bool direct_io = false,
+             int queue_frames = 8);
+
+    int write(const AVFrame *frame);
+
+    // 等写线程把队列里的帧写完，再关闭文件
+    int close();
+
+    static bool supported(AVPixelFormat format);
+
+private:
+    void writer_loop();
+
+    int pack(const AVFrame *frame);
+    int flush_staging(bool final);
+
+    const AVFrame *convert(const AVFrame *frame);
+
+private:
+    int           fd_         = -1;
+    bool          direct_io_  = false;
+    AVPixelFormat out_format_ = AV_PIX_FMT_NONE;
+
+    // 暂存区，按4096对齐，O_DIRECT时每次只写出4096整数倍的部分
+    uint8_t *staging_      = nullptr;
+    size_t   staging_size_ = 0;
+    size_t   staging_used_ = 0;
+
+    struct SwsContext *sws_ctx_   = nullptr;
+    AVFrame           *converted_ = nullptr;
+
+    std::unique_ptr<Utils::BoundedQueue<AVFrame *>> queue_;
+    std::thread                                     thread_;
+    std::atomic<int>                                error_{0};
+};
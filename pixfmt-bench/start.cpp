@@ -0,0 +1,279 @@
+/**
+ * @brief pixfmt_kernels的校验和测速
+ * 先用随机数据在各种宽高、带padding的stride下把每个SIMD级别的结果和标量实现逐字节比较，
+ * 再按给定分辨率测每个转换的吞吐（读+写的字节数/耗时，GB/s）
+ */
+
+#include "pixfmt_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace Utils::PixFmt;
+
+// 一帧4:2:0（8bit或16bit）或YUYV的源/目的缓冲，每行后面留padding，验证stride处理
+struct Image {
+    int                  width  = 0;
+    int                  height = 0;
+    int                  bpp    = 1; // 每个样本的字节数
+    int                  stride[3];
+    std::vector<uint8_t> plane[3];
+
+    Image(int w, int h, int bytes, int planes, int padding) {
+        width  = w;
+        height = h;
+        bpp    = bytes;
+        int cw = (w + 1) / 2;
+        int ch = (h + 1) / 2;
+        for (int p = 0; p < 3; p++) {
+            stride[p] = 0;
+        }
+        if (planes == 0) {
+            // YUYV：一个平面，每像素两个字节
+            stride[0] = w * 2 + padding;
+            plane[0].resize((size_t)stride[0] * h);
+            return;
+        }
+        stride[0] = w * bytes + padding;
+        plane[0].resize((size_t)stride[0] * h);
+        if (planes == 2) {
+            // NV12/P010：交织的UV平面
+            stride[1] = cw * 2 * bytes + padding;
+            plane[1].resize((size_t)stride[1] * ch);
+            return;
+        }
+        for (int p = 1; p < 3; p++) {
+            stride[p] = cw * bytes + padding;
+            plane[p].resize((size_t)stride[p] * ch);
+        }
+    }
+
+    void fill(std::mt19937 &rng, uint16_t max) {
+        for (auto &p : plane) {
+            if (bpp == 1) {
+                for (auto &b : p) {
+                    b = (uint8_t)rng();
+                }
+                continue;
+            }
+            for (size_t i = 0; i + 1 < p.size(); i += 2) {
+                uint16_t v = (uint16_t)(rng() % (max + 1u));
+                memcpy(&p[i], &v, 2);
+            }
+        }
+    }
+
+    size_t bytes() const {
+        return plane[0].size() + plane[1].size() + plane[2].size();
+    }
+};
+
+// 一种转换：src->dst，按给定的内核
+struct Case {
+    const char *name;
+    int         src_bytes, src_planes; // planes: 0为YUYV，2为半平面，3为平面
+    int         dst_bytes, dst_planes;
+    uint16_t    max_value; // 16bit源的取值上限
+    std::function<void(const Image &, Image &, const Kernels &)> run;
+};
+
+static std::vector<Case> make_cases() {
+    std::vector<Case> cases;
+    cases.push_back({"i420->nv12", 1, 3, 1, 2, 255, [](const Image &s, Image &d, const Kernels &k) {
+                         i420ToNv12(s.plane[0].data(), s.stride[0], s.plane[1].data(), s.stride[1],
+                                    s.plane[2].data(), s.stride[2], d.plane[0].data(), d.stride[0],
+                                    d.plane[1].data(), d.stride[1], s.width, s.height, k);
+                     }});
+    cases.push_back({"nv12->i420", 1, 2, 1, 3, 255, [](const Image &s, Image &d, const Kernels &k) {
+                         nv12ToI420(s.plane[0].data(), s.stride[0], s.plane[1].data(), s.stride[1],
+                                    d.plane[0].data(), d.stride[0], d.plane[1].data(), d.stride[1],
+                                    d.plane[2].data(), d.stride[2], s.width, s.height, k);
+                     }});
+    cases.push_back({"i010->p010", 2, 3, 2, 2, 1023, [](const Image &s, Image &d, const Kernels &k) {
+                         i010ToP010(s.plane[0].data(), s.stride[0], s.plane[1].data(), s.stride[1],
+                                    s.plane[2].data(), s.stride[2], d.plane[0].data(), d.stride[0],
+                                    d.plane[1].data(), d.stride[1], s.width, s.height, k);
+                     }});
+    cases.push_back({"p010->i010", 2, 2, 2, 3, 65535, [](const Image &s, Image &d, const Kernels &k) {
+                         p010ToI010(s.plane[0].data(), s.stride[0], s.plane[1].data(), s.stride[1],
+                                    d.plane[0].data(), d.stride[0], d.plane[1].data(), d.stride[1],
+                                    d.plane[2].data(), d.stride[2], s.width, s.height, k);
+                     }});
+    cases.push_back({"yuyv->i420", 1, 0, 1, 3, 255, [](const Image &s, Image &d, const Kernels &k) {
+                         yuyvToI420(s.plane[0].data(), s.stride[0], d.plane[0].data(), d.stride[0],
+                                    d.plane[1].data(), d.stride[1], d.plane[2].data(), d.stride[2], s.width,
+                                    s.height, k);
+                     }});
+    cases.push_back({"i420->yuyv", 1, 3, 1, 0, 255, [](const Image &s, Image &d, const Kernels &k) {
+                         i420ToYuyv(s.plane[0].data(), s.stride[0], s.plane[1].data(), s.stride[1],
+                                    s.plane[2].data(), s.stride[2], d.plane[0].data(), d.stride[0], s.width,
+                                    s.height, k);
+                     }});
+    return cases;
+}
+
+static std::vector<SimdLevel> available_levels() {
+    std::vector<SimdLevel> levels;
+    SimdLevel              best = detectSimdLevel();
+    for (int l = 0; l <= (int)best; l++) {
+        levels.push_back((SimdLevel)l);
+    }
+    return levels;
+}
+
+// padding里的字节也参与比较：内核不能写出一行的有效范围
+static int verify(const Case &c, const std::vector<SimdLevel> &levels) {
+    std::mt19937 rng(1234);
+    bool yuyv = c.src_planes == 0 || c.dst_planes == 0;
+    for (int width = 1; width <= 160; width++) {
+        if (yuyv && width % 2) {
+            continue;
+        }
+        for (int height : {1, 2, 3, 8}) {
+            // 16bit格式的stride必须是偶数
+            int   padding = (width % 7) * 2;
+            Image src(width, height, c.src_bytes, c.src_planes, padding);
+            src.fill(rng, c.max_value);
+
+            Image ref(width, height, c.dst_bytes, c.dst_planes, padding);
+            c.run(src, ref, kernels(SimdLevel::SCALAR));
+            for (SimdLevel level : levels) {
+                Image out(width, height, c.dst_bytes, c.dst_planes, padding);
+                c.run(src, out, kernels(level));
+                for (int p = 0; p < 3; p++) {
+                    if (out.plane[p] != ref.plane[p]) {
+                        fprintf(stderr, "%s %s mismatch, %dx%d plane %d\n", c.name, simdName(level), width, height,
+                                p);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// SAD的结果是一个数，单独比较；两行数据差异从全同到全随机都覆盖
+static int verify_sad(const std::vector<SimdLevel> &levels) {
+    std::mt19937         rng(4321);
+    std::vector<uint8_t> a(4096), b(4096);
+    for (int width = 0; width <= 300; width++) {
+        for (int noise : {0, 3, 255}) {
+            for (int i = 0; i < width; i++) {
+                a[i] = (uint8_t)rng();
+                b[i] = (uint8_t)(a[i] + (noise ? (int)(rng() % (noise + 1)) - noise / 2 : 0));
+            }
+            uint32_t ref = kernels(SimdLevel::SCALAR).sad(a.data(), b.data(), width);
+            for (SimdLevel level : levels) {
+                if (kernels(level).sad(a.data(), b.data(), width) != ref) {
+                    fprintf(stderr, "sad %s mismatch, width %d\n", simdName(level), width);
+                    return -1;
+                }
+            }
+        }
+    }
+    // 最大值：一整行4K全是0和255
+    std::fill(a.begin(), a.end(), 0);
+    std::fill(b.begin(), b.end(), 255);
+    for (SimdLevel level : levels) {
+        if (kernels(level).sad(a.data(), b.data(), (int)a.size()) != 255u * a.size()) {
+            fprintf(stderr, "sad %s overflow\n", simdName(level));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bench(const Case &c, const std::vector<SimdLevel> &levels, int width, int height, int seconds_ms) {
+    std::mt19937 rng(5678);
+    Image        src(width, height, c.src_bytes, c.src_planes, 0);
+    Image        dst(width, height, c.dst_bytes, c.dst_planes, 0);
+    src.fill(rng, c.max_value);
+
+    double bytes = (double)(src.bytes() + dst.bytes());
+    printf("%-12s", c.name);
+    for (SimdLevel level : levels) {
+        const Kernels &k = kernels(level);
+        c.run(src, dst, k); // 预热，页面换入
+
+        int    frames = 0;
+        auto   start  = std::chrono::steady_clock::now();
+        double ms     = 0;
+        while (ms < seconds_ms) {
+            c.run(src, dst, k);
+            frames++;
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("  %s %6.2f GB/s", simdName(level), bytes * frames / (ms / 1000) / 1e9);
+    }
+    printf("\n");
+}
+
+// 两帧亮度的SAD，读两个平面
+static void bench_sad(const std::vector<SimdLevel> &levels, int width, int height, int seconds_ms) {
+    std::mt19937 rng(8765);
+    Image        a(width, height, 1, 3, 0);
+    Image        b(width, height, 1, 3, 0);
+    a.fill(rng, 255);
+    b.fill(rng, 255);
+
+    double   bytes = (double)a.plane[0].size() * 2;
+    uint32_t total = 0;
+    printf("%-12s", "luma sad");
+    for (SimdLevel level : levels) {
+        const Kernels &k      = kernels(level);
+        int            frames = 0;
+        auto           start  = std::chrono::steady_clock::now();
+        double         ms     = 0;
+        while (ms < seconds_ms) {
+            for (int y = 0; y < height; y++) {
+                total += k.sad(&a.plane[0][(size_t)y * a.stride[0]], &b.plane[0][(size_t)y * b.stride[0]], width);
+            }
+            frames++;
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("  %s %6.2f GB/s", simdName(level), bytes * frames / (ms / 1000) / 1e9);
+    }
+    // 用掉结果，不让编译器把循环优化掉
+    printf("%s\n", total == 1 ? " " : "");
+}
+
+int main(int argc, char *argv[]) {
+    int width  = 3840;
+    int height = 2160;
+    if (argc >= 3) {
+        width  = atoi(argv[1]) & ~1;
+        height = atoi(argv[2]);
+    }
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "%s [width height]\n", argv[0]);
+        return -1;
+    }
+
+    std::vector<SimdLevel> levels = available_levels();
+    std::vector<Case>      cases  = make_cases();
+    printf("cpu simd: %s\n", simdName(detectSimdLevel()));
+
+    for (const Case &c : cases) {
+        if (verify(c, levels) < 0) {
+            return -1;
+        }
+    }
+    if (verify_sad(levels) < 0) {
+        return -1;
+    }
+    printf("all kernels match scalar reference\n");
+
+    printf("%dx%d, read+write bytes per second\n", width, height);
+    for (const Case &c : cases) {
+        bench(c, levels, width, height, 500);
+    }
+    bench_sad(levels, width, height, 500);
+    return 0;
+}
@@ -13,6 +13,9 @@ extern "C" {
 #include <cstdio>
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include "pixfmt_kernels.hpp"
 
 
 char        errStr[10240] = {0};
@@ -158,24 +161,18 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    char uBuffer[frame->width * frame->height / 4];
-    char vBuffer[frame->width * frame->height / 4];
-
+    // 一帧YUV420P放在堆上，4K时在栈上会溢出
+    const int            y_size  = frame->width * frame->height;
+    const int            uv_size = (frame->width / 2) * (frame->height / 2);
+    std::vector<uint8_t> yuv(y_size + uv_size * 2);
 
-    while (!feof(pFile)) {
+    while (fread(yuv.data(), 1, yuv.size(), pFile) == yuv.size()) {
 
-        fread(frame->data[0], 1, frame->width * frame->height, pFile); // y
-
-        // YUV420P to NV12
-        memset(uBuffer, 0, sizeof(uBuffer));
-        memset(vBuffer, 0, sizeof(vBuffer));
-        fread(uBuffer, 1, frame->width * frame->height / 4, pFile);    // u
-        fread(vBuffer, 1, frame->width * frame->height / 4, pFile);    // v
         // 这里读取YUV420P的文件，转换成NV12格式
-        for (int i = 0; i < frame->width * frame->height / 4; i++) {
-            frame->data[1][i * 2]     = uBuffer[i];
-            frame->data[1][i * 2 + 1] = vBuffer[i];
-        }
+        Utils::PixFmt::i420ToNv12(yuv.data(), frame->width, yuv.data() + y_size, frame->width / 2,
+                                  yuv.data() + y_size + uv_size, frame->width / 2, frame->data[0],
+                                  frame->linesize[0], frame->data[1], frame->linesize[1], frame->width,
+                                  frame->height);
 
         // NV12
         // fread(frame->data[1], 1, frame->width * frame->height / 2, pFile); // uv
@@ -0,0 +1,168 @@
+/**
+ * @brief 按slice输出和整帧输出的首字节时延对比
+ * 同一组编码参数分别用整帧回调（EncodeCallback）和slice回调（SliceCallback）编码同样的合成画面，
+ * 记录从调用encode到第一个字节交出来的时间（首字节）和到整帧交完的时间，单线程和多线程各测一次
+ */
+
+#include "x264_slice_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 带噪声的背景上移动的渐变块，每帧都有运动，编码量接近真实画面
+struct Source {
+    int                  width, height;
+    std::vector<uint8_t> y, u, v, noise;
+
+    Source(int w, int h)
+        : width(w)
+        , height(h)
+        , y((size_t)w * h)
+        , u((size_t)w * h / 4)
+        , v((size_t)w * h / 4)
+        , noise((size_t)w * h) {
+        std::mt19937 rng(42);
+        for (auto &n : noise) {
+            n = (uint8_t)(rng() % 24);
+        }
+    }
+
+    void fill(int index, AVFrame *frame) {
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                int moving = ((col + index * 7) / 32 + (row + index * 3) / 32) % 2 ? 160 : 60;
+                y[(size_t)row * width + col] =
+                    (uint8_t)(moving + noise[((size_t)row * width + col + index * 13) % noise.size()]);
+            }
+        }
+        for (size_t i = 0; i < u.size(); i++) {
+            u[i] = (uint8_t)(128 + (i / width + index) % 32);
+            v[i] = (uint8_t)(128 - (i % width + index) % 32);
+        }
+        frame->data[0]     = y.data();
+        frame->data[1]     = u.data();
+        frame->data[2]     = v.data();
+        frame->linesize[0] = width;
+        frame->linesize[1] = width / 2;
+        frame->linesize[2] = width / 2;
+        frame->width       = width;
+        frame->height      = height;
+        frame->format      = AV_PIX_FMT_YUV420P;
+        frame->pts         = index;
+        frame->pict_type   = AV_PICTURE_TYPE_NONE;
+    }
+};
+
+struct Result {
+    std::vector<double> first_ms; // encode开始到第一个字节
+    std::vector<double> last_ms;  // encode开始到整帧交完
+    uint64_t            bytes  = 0;
+    uint64_t            slices = 0;
+};
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(p * (values.size() - 1))];
+}
+
+static double average(const std::vector<double> &values) {
+    double sum = 0;
+    for (double v : values) {
+        sum += v;
+    }
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static int run(Source &source, int frames, int slices, int threads, bool sliced, Result &result) {
+    Codec::X264SliceEncoder encoder(0);
+    encoder.setSlices(slices);
+    encoder.setThreadCount(threads);
+
+    Clock::time_point start, first, last;
+    bool              got_first = false;
+    auto              on_bytes  = [&](size_t size) {
+        last = Clock::now();
+        if (!got_first) {
+            first     = last;
+            got_first = true;
+        }
+        result.bytes += size;
+    };
+
+    Codec::BasicEncoder::EncodeCallback frame_callback = nullptr;
+    if (sliced) {
+        encoder.setSliceCallback([&](uint64_t, const uint8_t *, int size, int, bool) {
+            on_bytes(size);
+            result.slices++;
+        });
+    } else {
+        frame_callback = [&](uint64_t, AVPacket *pkt) { on_bytes(pkt->size); };
+    }
+    if (encoder.open(AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P, nullptr, source.width, source.height,
+                     frame_callback) < 0) {
+        return -1;
+    }
+
+    AVFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (int i = 0; i < frames; i++) {
+        source.fill(i, &frame);
+        got_first = false;
+        start     = Clock::now();
+        if (encoder.encode(i, &frame) < 0) {
+            return -1;
+        }
+        if (got_first) {
+            result.first_ms.push_back(ms_since(start, first));
+            result.last_ms.push_back(ms_since(start, last));
+        }
+    }
+    encoder.flush(frames);
+    encoder.close();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int width  = argc > 1 ? atoi(argv[1]) & ~1 : 1920;
+    int height = argc > 2 ? atoi(argv[2]) & ~1 : 1080;
+    int frames = argc > 3 ? atoi(argv[3]) : 100;
+    int slices = argc > 4 ? atoi(argv[4]) : X264_SLICE_COUNT;
+    if (width <= 0 || height <= 0 || frames <= 0 || slices <= 0) {
+        fprintf(stderr, "%s [width height frames slices]\n", argv[0]);
+        return -1;
+    }
+
+    Source source(width, height);
+    printf("%dx%d, %d frames, %d slices per frame\n", width, height, frames, slices);
+    printf("%-8s %-7s %10s %10s %10s %10s %8s\n", "threads", "output", "first avg", "first p99", "frame avg",
+           "frame p99", "kbytes");
+    // 单线程时slice按顺序编码，第一个slice在大约1/slices帧时间时就能交出；
+    // 多线程时各slice并行编码，首字节和整帧的差距变小
+    for (int threads : {1, 0}) {
+        for (bool sliced : {false, true}) {
+            Result result;
+            if (run(source, frames, slices, threads, sliced, result) < 0) {
+                fprintf(stderr, "encode failed\n");
+                return -1;
+            }
+            printf("%-8s %-7s %8.2fms %8.2fms %8.2fms %8.2fms %8lu\n", threads ? "1" : "auto",
+                   sliced ? "slice" : "frame", average(result.first_ms), percentile(result.first_ms, 0.99),
+                   average(result.last_ms), percentile(result.last_ms, 0.99), (unsigned long)(result.bytes / 1024));
+        }
+    }
+    return 0;
+}
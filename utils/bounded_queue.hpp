@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace Utils {
+
+    /**
+     * @brief 有界阻塞队列，用于线程间传递数据
+     * 队列满时push阻塞，队列空时pop阻塞；close之后push失败，pop取完剩余数据后失败
+     */
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity)
+            : capacity_(capacity == 0 ? 1 : capacity) {}
+
+        BoundedQueue(const BoundedQueue &) = delete;
+
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+            if (closed_) {
+                return false;
+            }
+            items_.push_back(std::move(item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+            if (items_.empty()) {
+                return false;
+            }
+            item = std::move(items_.front());
+            items_.pop_front();
+            not_full_.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            not_full_.notify_all();
+            not_empty_.notify_all();
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return items_.size();
+        }
+
+    private:
+        std::mutex              mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::deque<T>           items_;
+        size_t                  capacity_ = 1;
+        bool                    closed_   = false;
+    };
+} // namespace Utils
@@ -0,0 +1,312 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "bounded_queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+
+    /**
+     * @brief 帧内编码的图片导出（PNG/MJPEG）
+     * 每张图片可以独立压缩，所以把帧分发给多个线程，每个线程有自己的编码上下文；
+     * 输出为按序号命名的文件，或者经过重排缓冲按输入顺序拼接成一个文件
+     */
+    class ImageExporter {
+    public:
+        struct Options {
+            AVCodecID codec   = AV_CODEC_ID_PNG;
+            int       threads = 0; // 0表示CPU核数
+
+            // 含%d/%05d时每帧写一个文件，否则所有图片按顺序写进这一个文件
+            std::string output;
+
+            // PNG速度选项：zlib压缩等级0~9（-1为编码器默认），预测滤波none/sub/up/avg/paeth/mixed
+            int         png_compression = -1;
+            std::string png_pred;
+
+            // MJPEG质量，qscale 2~31，0为编码器默认
+            int mjpeg_qscale = 0;
+        };
+
+        ImageExporter() {}
+        ~ImageExporter() {
+            close();
+        }
+
+        ImageExporter(const ImageExporter &) = delete;
+
+        int open(const Options &options) {
+            close();
+            if (options.codec != AV_CODEC_ID_PNG && options.codec != AV_CODEC_ID_MJPEG) {
+                std::cout << "image exporter only support png/mjpeg, " << options.codec << std::endl;
+                return -1;
+            }
+            options_   = options;
+            numbered_  = options.output.find('%') != std::string::npos;
+            int thread = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+            thread     = thread > 0 ? thread : 1;
+
+            if (!numbered_) {
+                outfile_ = fopen(options.output.c_str(), "wb");
+                if (outfile_ == nullptr) {
+                    std::cout << options.output << " open failed" << std::endl;
+                    return -1;
+                }
+            }
+
+            window_     = (uint64_t)thread * 2;
+            next_index_ = 0;
+            next_write_ = 0;
+            error_      = 0;
+            queue_.reset(new BoundedQueue<Job>(window_));
+            for (int i = 0; i < thread; i++) {
+                workers_.emplace_back(&ImageExporter::worker_loop, this);
+            }
+            return 0;
+        }
+
+        // 只增加帧的引用，编码在工作线程里做
+        int write(const AVFrame *frame) {
+            if (!queue_ || frame == nullptr) {
+                return -1;
+            }
+            Job job;
+            job.index = next_index_++;
+            job.frame = av_frame_clone(frame);
+            if (job.frame == nullptr) {
+                return -1;
+            }
+            if (!queue_->push(job)) {
+                av_frame_free(&job.frame);
+                return -1;
+            }
+            return error_;
+        }
+
+        // 等待所有图片编码、写完
+        int close() {
+            if (queue_) {
+                queue_->close();
+            }
+            for (auto &t : workers_) {
+                t.join();
+            }
+            workers_.clear();
+            queue_.reset();
+
+            for (auto &item : reorder_) {
+                av_packet_free(&item.second);
+            }
+            reorder_.clear();
+            if (outfile_) {
+                fclose(outfile_);
+                outfile_ = nullptr;
+            }
+            return error_;
+        }
+
+    private:
+        struct Job {
+            uint64_t index = 0;
+            AVFrame *frame = nullptr;
+        };
+
+        // 每个工作线程的编码上下文，第一帧到来时按帧的尺寸打开
+        struct Worker {
+            AVCodecContext    *ctx       = nullptr;
+            struct SwsContext *sws       = nullptr;
+            AVFrame           *converted = nullptr;
+            AVPacket          *pkt       = nullptr;
+
+            ~Worker() {
+                avcodec_free_context(&ctx);
+                sws_freeContext(sws);
+                av_frame_free(&converted);
+                av_packet_free(&pkt);
+            }
+        };
+
+        // 编码器不支持帧的像素格式时转换：PNG转RGB24，MJPEG转YUVJ420P
+        static AVPixelFormat pick_format(const AVCodec *codec, AVPixelFormat in) {
+            for (const AVPixelFormat *p = codec->pix_fmts; p && *p != AV_PIX_FMT_NONE; p++) {
+                if (*p == in) {
+                    return in;
+                }
+            }
+            return codec->id == AV_CODEC_ID_PNG ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_YUVJ420P;
+        }
+
+        int open_worker(Worker &w, const AVFrame *frame) {
+            const AVCodec *codec = avcodec_find_encoder(options_.codec);
+            if (codec == nullptr) {
+                std::cout << "find encoder failed, " << options_.codec << std::endl;
+                return -1;
+            }
+            w.ctx = avcodec_alloc_context3(codec);
+            if (w.ctx == nullptr) {
+                return -1;
+            }
+            w.ctx->width                 = frame->width;
+            w.ctx->height                = frame->height;
+            w.ctx->pix_fmt               = pick_format(codec, (AVPixelFormat)frame->format);
+            w.ctx->time_base             = AVRational{1, 25};
+            w.ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+            // 并行在图片之间做，单个上下文不再开线程
+            w.ctx->thread_count = 1;
+
+            if (options_.codec == AV_CODEC_ID_PNG) {
+                if (options_.png_compression >= 0) {
+                    w.ctx->compression_level = options_.png_compression;
+                }
+                if (!options_.png_pred.empty()) {
+                    av_opt_set(w.ctx->priv_data, "pred", options_.png_pred.c_str(), 0);
+                }
+            } else if (options_.mjpeg_qscale > 0) {
+                w.ctx->flags |= AV_CODEC_FLAG_QSCALE;
+                w.ctx->global_quality = FF_QP2LAMBDA * options_.mjpeg_qscale;
+            }
+
+            int ret = avcodec_open2(w.ctx, codec, NULL);
+            if (ret < 0) {
+                char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+                av_strerror(ret, err, sizeof(err));
+                std::cout << "image encoder open failed, " << err << std::endl;
+                avcodec_free_context(&w.ctx);
+                return -1;
+            }
+            w.pkt = av_packet_alloc();
+            return w.pkt ? 0 : -1;
+        }
+
+        const AVFrame *convert(Worker &w, const AVFrame *frame) {
+            if (frame->format == w.ctx->pix_fmt) {
+                return frame;
+            }
+            w.sws = sws_getCachedContext(w.sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                         w.ctx->width, w.ctx->height, w.ctx->pix_fmt, SWS_BILINEAR, NULL, NULL,
+                                         NULL);
+            if (w.sws == nullptr) {
+                return nullptr;
+            }
+            if (w.converted == nullptr) {
+                w.converted         = av_frame_alloc();
+                w.converted->width  = w.ctx->width;
+                w.converted->height = w.ctx->height;
+                w.converted->format = w.ctx->pix_fmt;
+                if (av_frame_get_buffer(w.converted, 0) < 0) {
+                    av_frame_free(&w.converted);
+                    return nullptr;
+                }
+            }
+            sws_scale(w.sws, frame->data, frame->linesize, 0, frame->height, w.converted->data,
+                      w.converted->linesize);
+            w.converted->pts = frame->pts;
+            return w.converted;
+        }
+
+        // 编码一张图片，帧内编码器送一帧就出一个packet
+        AVPacket *encode(Worker &w, const AVFrame *frame) {
+            if (w.ctx == nullptr && open_worker(w, frame) < 0) {
+                return nullptr;
+            }
+            const AVFrame *in = convert(w, frame);
+            if (in == nullptr || avcodec_send_frame(w.ctx, in) < 0) {
+                return nullptr;
+            }
+            if (avcodec_receive_packet(w.ctx, w.pkt) < 0) {
+                return nullptr;
+            }
+            AVPacket *out = av_packet_alloc();
+            av_packet_move_ref(out, w.pkt);
+            return out;
+        }
+
+        void worker_loop() {
+            Worker w;
+            Job    job;
+            while (queue_->pop(job)) {
+                if (!numbered_) {
+                    // 拼接输出时，领先写入位置太多的图片先不编码，限制重排缓冲的大小
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait(lock, [&] { return job.index < next_write_ + window_; });
+                }
+
+                AVPacket *pkt = encode(w, job.frame);
+                av_frame_free(&job.frame);
+                if (pkt == nullptr) {
+                    error_ = -1;
+                }
+
+                if (numbered_) {
+                    write_numbered(job.index, pkt);
+                    av_packet_free(&pkt);
+                    continue;
+                }
+
+                // 按序号顺序写出，编码失败的图片用空位占住序号
+                std::lock_guard<std::mutex> lock(mutex_);
+                reorder_[job.index] = pkt;
+                for (auto it = reorder_.find(next_write_); it != reorder_.end(); it = reorder_.find(next_write_)) {
+                    if (it->second) {
+                        fwrite(it->second->data, 1, it->second->size, outfile_);
+                        av_packet_free(&it->second);
+                    }
+                    reorder_.erase(it);
+                    next_write_++;
+                }
+                cond_.notify_all();
+            }
+        }
+
+        void write_numbered(uint64_t index, AVPacket *pkt) {
+            if (pkt == nullptr) {
+                return;
+            }
+            char filename[1024];
+            if (av_get_frame_filename2(filename, sizeof(filename), options_.output.c_str(), (int)index, 0) < 0) {
+                error_ = -1;
+                return;
+            }
+            FILE *file = fopen(filename, "wb");
+            if (file == nullptr) {
+                std::cout << filename << " open failed" << std::endl;
+                error_ = -1;
+                return;
+            }
+            fwrite(pkt->data, 1, pkt->size, file);
+            fclose(file);
+        }
+
+    private:
+        Options options_;
+        bool    numbered_ = false;
+        FILE   *outfile_  = nullptr;
+
+        std::unique_ptr<BoundedQueue<Job>> queue_;
+        std::vector<std::thread>           workers_;
+
+        std::mutex                     mutex_;
+        std::condition_variable        cond_;
+        std::map<uint64_t, AVPacket *> reorder_;
+        uint64_t                       window_     = 2;
+        uint64_t                       next_index_ = 0;
+        uint64_t                       next_write_ = 0;
+        std::atomic<int>               error_{0};
+    };
+} // namespace Utils
@@ -0,0 +1,197 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Utils {
+
+    /**
+     * @brief 只读内存映射的输入文件，代替fread读取裸流/YUV文件
+     * 数据直接从映射的页里读，没有内核到用户缓冲区的拷贝；
+     * 可选的预读线程在读取位置前面提前把页面换入，读的线程不会卡在缺页上
+     */
+    class MappedFile {
+    public:
+        MappedFile() {}
+        ~MappedFile() {
+            close();
+        }
+
+        MappedFile(const MappedFile &) = delete;
+
+        // 映射失败（比如管道、空文件）返回-1，调用者应回退到fread
+        int open(const std::string &filename, bool readahead = false) {
+            close();
+
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return -1;
+            }
+            struct stat st;
+            if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+                ::close(fd);
+                return -1;
+            }
+            void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) {
+                return -1;
+            }
+
+            data_      = (const uint8_t *)addr;
+            size_      = (size_t)st.st_size;
+            long page  = sysconf(_SC_PAGESIZE);
+            page_size_ = page > 0 ? (size_t)page : 4096;
+            map_size_  = (size_ + page_size_ - 1) / page_size_ * page_size_;
+
+            // 顺序读：内核加大预读并尽快回收读过的页
+            madvise((void *)data_, map_size_, MADV_SEQUENTIAL);
+            madvise((void *)data_, window(0), MADV_WILLNEED);
+
+            if (readahead) {
+                stop_     = false;
+                position_ = 0;
+                readahead_thread_ = std::thread(&MappedFile::readahead_loop, this);
+            }
+            return 0;
+        }
+
+        void close() {
+            if (readahead_thread_.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                cond_.notify_all();
+                readahead_thread_.join();
+            }
+            if (data_) {
+                munmap((void *)data_, map_size_);
+            }
+            data_     = nullptr;
+            size_     = 0;
+            map_size_ = 0;
+        }
+
+        bool isopen() const {
+            return data_ != nullptr;
+        }
+
+        const uint8_t *data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        // 通知预读线程当前已经读到offset
+        void advance(size_t offset) {
+            if (!readahead_thread_.joinable()) {
+                return;
+            }
+            position_.store(offset, std::memory_order_relaxed);
+            cond_.notify_one();
+        }
+
+        bool contains(const uint8_t *p, size_t len) const {
+            return data_ && p >= data_ && p + len <= data_ + size_;
+        }
+
+        // 解码器可能越界读AV_INPUT_BUFFER_PADDING_SIZE字节，只有这部分仍在映射内才能直接引用映射区
+        bool padded(const uint8_t *p, size_t len) const {
+            return contains(p, len) && p + len + AV_INPUT_BUFFER_PADDING_SIZE <= data_ + map_size_;
+        }
+
+        /**
+         * @brief 把映射区的一段数据包装成AVBufferRef，给AVPacket/AVFrame引用，不拷贝数据
+         * 释放回调什么都不做，所以所有引用它的packet/frame必须在close之前释放
+         */
+        AVBufferRef *ref(const uint8_t *p, size_t len) const {
+            if (!contains(p, len)) {
+                return nullptr;
+            }
+            return av_buffer_create((uint8_t *)p, len, noop_free, nullptr, AV_BUFFER_FLAG_READONLY);
+        }
+
+    private:
+        static void noop_free(void *opaque, uint8_t *data) {
+            (void)opaque;
+            (void)data;
+        }
+
+        size_t window(size_t offset) const {
+            size_t end = offset + kReadaheadWindow;
+            return (end > map_size_ ? map_size_ : end) - offset;
+        }
+
+        // 保持读取位置之后kReadaheadWindow字节的页面已经在内存里
+        void readahead_loop() {
+            size_t done = 0;
+            while (true) {
+                size_t pos = 0;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                        return stop_ ||
+                               (done < map_size_ &&
+                                position_.load(std::memory_order_relaxed) + kReadaheadWindow > done);
+                    });
+                    if (stop_) {
+                        break;
+                    }
+                    pos = position_.load(std::memory_order_relaxed);
+                }
+                if (done >= map_size_) {
+                    continue;
+                }
+                if (done < pos) {
+                    done = pos / page_size_ * page_size_;
+                }
+                size_t end = pos + kReadaheadWindow;
+                if (end > map_size_) {
+                    end = map_size_;
+                }
+                if (end <= done) {
+                    continue;
+                }
+                madvise((void *)(data_ + done), end - done, MADV_WILLNEED);
+                // WILLNEED只是提示，逐页读一个字节确保缺页在这个线程里处理完
+                volatile uint8_t sink = 0;
+                for (size_t off = done; off < end; off += page_size_) {
+                    sink = sink + data_[off];
+                }
+                done = end;
+            }
+        }
+
+    private:
+        static constexpr size_t kReadaheadWindow = 32 << 20;
+
+        const uint8_t *data_      = nullptr;
+        size_t         size_      = 0;
+        size_t         map_size_  = 0;
+        size_t         page_size_ = 4096;
+
+        std::thread             readahead_thread_;
+        std::mutex              mutex_;
+        std::condition_variable cond_;
+        std::atomic<size_t>     position_{0};
+        bool                    stop_ = false;
+    };
+} // namespace Utils
@@ -0,0 +1,322 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/mem.h>
+}
+
+#include <sys/uio.h>
+
+#include "nal_iterator.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Utils {
+
+    /**
+     * @brief H264 NAL分隔格式转换：长度前缀（AVCC，1/2/4字节）和start code（Annex-B）互转
+     * 每个NAL前面原来的start code/长度字段和输出需要的一样长时，直接在原数据上改写；
+     * 否则输出为iovec列表，NAL数据本身仍指向原数据，只有新的头部放在内部缓冲里。
+     * 输出Annex-B时，没有带SPS/PPS的IDR前面插入最近一次的参数集，代替h264_mp4toannexb
+     */
+    class NalFramer {
+    public:
+        NalFramer() {}
+        ~NalFramer() {}
+
+        // length_size为0表示Annex-B，否则为NAL长度字段的字节数(1/2/4)
+        int init(int in_length_size, int out_length_size) {
+            if (!valid_length_size(in_length_size) || !valid_length_size(out_length_size)) {
+                return -1;
+            }
+            in_length_size_  = in_length_size;
+            out_length_size_ = out_length_size;
+            return 0;
+        }
+
+        // 从输入的extradata（avcC或Annex-B形式）读取SPS/PPS；是avcC时同时确定输入的长度字段字节数
+        int set_extradata(const uint8_t *extradata, int size) {
+            if (extradata == nullptr || size <= 0) {
+                return -1;
+            }
+            if (extradata[0] != 1) {
+                std::vector<Nal> nals;
+                split(extradata, size, 0, nals);
+                for (const Nal &nal : nals) {
+                    learn_param(extradata + nal.offset, nal.size);
+                }
+                return sps_.empty() || pps_.empty() ? -1 : 0;
+            }
+
+            if (size < 7) {
+                return -1;
+            }
+            int    length_size = (extradata[4] & 0x03) + 1;
+            size_t pos         = 5;
+            for (int table = 0; table < 2; table++) {
+                if (pos >= (size_t)size) {
+                    return -1;
+                }
+                int count = table == 0 ? (extradata[pos] & 0x1f) : extradata[pos];
+                pos++;
+                for (int i = 0; i < count; i++) {
+                    if (pos + 2 > (size_t)size) {
+                        return -1;
+                    }
+                    size_t len = ((size_t)extradata[pos] << 8) | extradata[pos + 1];
+                    pos += 2;
+                    if (pos + len > (size_t)size) {
+                        return -1;
+                    }
+                    learn_param(extradata + pos, len);
+                    pos += len;
+                }
+            }
+            if (length_size == 3) {
+                return -1;
+            }
+            in_length_size_ = length_size;
+            return sps_.empty() || pps_.empty() ? -1 : 0;
+        }
+
+        /**
+         * @brief remux时按输入流确定输入格式，输出为长度前缀(4字节)时给输出流生成avcC
+         * 输入是Annex-B且extradata里没有参数集时，avcC要等第一个带SPS/PPS的packet之后才能生成
+         */
+        int init_remux(const AVCodecParameters *in, AVCodecParameters *out, bool out_avcc) {
+            in_length_size_  = 0;
+            out_length_size_ = out_avcc ? 4 : 0;
+            sps_.clear();
+            pps_.clear();
+            if (in->extradata_size > 0) {
+                set_extradata(in->extradata, in->extradata_size);
+            }
+            if (out == nullptr) {
+                return 0;
+            }
+
+            av_freep(&out->extradata);
+            out->extradata_size = 0;
+            std::vector<uint8_t> extradata;
+            if (out_avcc) {
+                if (build_avcc(extradata) < 0) {
+                    return -1;
+                }
+            } else {
+                extradata = params_annexb_;
+            }
+            if (extradata.empty()) {
+                return 0;
+            }
+            out->extradata = (uint8_t *)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (out->extradata == nullptr) {
+                return -1;
+            }
+            memcpy(out->extradata, extradata.data(), extradata.size());
+            out->extradata_size = (int)extradata.size();
+            return 0;
+        }
+
+        /**
+         * @brief 转换一段数据
+         * 能原地改写时改写data，iov里是data本身（Annex-B输出插入参数集时前面多一段）；
+         * 否则iov由内部缓冲里的新头部和data里的NAL数据交替组成，data不改动。
+         * iov指向的内部缓冲在下一次调用前有效。返回输出的总字节数
+         */
+        int convert(uint8_t *data, size_t size, std::vector<struct iovec> &iov) {
+            iov.clear();
+            split(data, size, in_length_size_, nals_);
+
+            bool has_idr    = false;
+            bool has_params = false;
+            bool in_place   = true;
+            for (const Nal &nal : nals_) {
+                int type = data[nal.offset] & 0x1f;
+                if (type == 7 || type == 8) {
+                    has_params = true;
+                    learn_param(data + nal.offset, nal.size);
+                } else if (type == 5) {
+                    has_idr = true;
+                }
+                if (out_length_size_ == 0) {
+                    in_place = in_place && (nal.prefix == 3 || nal.prefix == 4);
+                } else {
+                    in_place = in_place && nal.prefix == (size_t)out_length_size_;
+                }
+                // 长度字段放不下
+                if (out_length_size_ > 0 && out_length_size_ < 4 && nal.size >> (8 * out_length_size_)) {
+                    return -1;
+                }
+            }
+
+            bool   insert = out_length_size_ == 0 && has_idr && !has_params && !params_annexb_.empty();
+            size_t total  = 0;
+            if (insert) {
+                iov.push_back({params_annexb_.data(), params_annexb_.size()});
+                total += params_annexb_.size();
+            }
+
+            if (in_place) {
+                size_t begin = nals_.empty() ? size : nals_.front().offset - nals_.front().prefix;
+                for (const Nal &nal : nals_) {
+                    write_header(data + nal.offset - nal.prefix, nal.prefix, nal.size);
+                }
+                if (begin < size) {
+                    iov.push_back({data + begin, size - begin});
+                    total += size - begin;
+                }
+                return (int)total;
+            }
+
+            // 先把所有头部写进缓冲，再生成iov，避免缓冲扩容后指针失效
+            size_t header_size = out_length_size_ == 0 ? 4 : out_length_size_;
+            headers_.resize(nals_.size() * header_size);
+            for (size_t i = 0; i < nals_.size(); i++) {
+                write_header(headers_.data() + i * header_size, header_size, nals_[i].size);
+            }
+            for (size_t i = 0; i < nals_.size(); i++) {
+                iov.push_back({headers_.data() + i * header_size, header_size});
+                iov.push_back({data + nals_[i].offset, nals_[i].size});
+                total += header_size + nals_[i].size;
+            }
+            return (int)total;
+        }
+
+        // 转换AVPacket：能原地改写时不拷贝，否则按iov拼成新的packet数据
+        int convert(AVPacket *pkt) {
+            if (in_length_size_ == out_length_size_ && out_length_size_ > 0) {
+                return 0;
+            }
+            // 解复用出来的packet一般只有一个引用，这里不会拷贝
+            int ret = av_packet_make_writable(pkt);
+            if (ret < 0) {
+                return ret;
+            }
+            int total = convert(pkt->data, pkt->size, iov_);
+            if (total < 0) {
+                return -1;
+            }
+            if (iov_.size() == 1 && iov_[0].iov_base == pkt->data && (int)iov_[0].iov_len == pkt->size) {
+                return 0;
+            }
+
+            AVBufferRef *buf = av_buffer_alloc(total + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (buf == nullptr) {
+                return AVERROR(ENOMEM);
+            }
+            uint8_t *dst = buf->data;
+            for (const struct iovec &v : iov_) {
+                memcpy(dst, v.iov_base, v.iov_len);
+                dst += v.iov_len;
+            }
+            memset(dst, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+            av_buffer_unref(&pkt->buf);
+            pkt->buf  = buf;
+            pkt->data = buf->data;
+            pkt->size = total;
+            return 0;
+        }
+
+        // 由最近的SPS/PPS生成avcC（长度字段4字节），还没有参数集时返回-1
+        int build_avcc(std::vector<uint8_t> &avcc) const {
+            avcc.clear();
+            if (sps_.size() < 4 || pps_.empty()) {
+                return -1;
+            }
+            avcc.push_back(1);
+            avcc.push_back(sps_[1]); // profile_idc
+            avcc.push_back(sps_[2]); // constraint flags
+            avcc.push_back(sps_[3]); // level_idc
+            avcc.push_back(0xff);    // 长度字段4字节
+            avcc.push_back(0xe1);    // 1个SPS
+            avcc.push_back((uint8_t)(sps_.size() >> 8));
+            avcc.push_back((uint8_t)sps_.size());
+            avcc.insert(avcc.end(), sps_.begin(), sps_.end());
+            avcc.push_back(1); // 1个PPS
+            avcc.push_back((uint8_t)(pps_.size() >> 8));
+            avcc.push_back((uint8_t)pps_.size());
+            avcc.insert(avcc.end(), pps_.begin(), pps_.end());
+            return 0;
+        }
+
+        int in_length_size() const {
+            return in_length_size_;
+        }
+
+        int out_length_size() const {
+            return out_length_size_;
+        }
+
+    private:
+        struct Nal {
+            size_t offset = 0; // NAL头在数据里的位置
+            size_t size   = 0;
+            size_t prefix = 0; // 前面的start code（含前导0）或长度字段的字节数
+        };
+
+        static bool valid_length_size(int length_size) {
+            return length_size == 0 || length_size == 1 || length_size == 2 || length_size == 4;
+        }
+
+        // Annex-B时NAL后面的0属于下一个start code（trailing_zero_8bits），第一个NAL之前的所有字节都算作它的前缀
+        static void split(const uint8_t *data, size_t size, int length_size, std::vector<Nal> &nals) {
+            nals.clear();
+            Utils::forEachNal(data, size, length_size, [&](const NalUnit &unit) {
+                Nal nal;
+                nal.offset = unit.data - data;
+                nal.size   = unit.size;
+                nal.prefix = unit.prefix;
+                nals.push_back(nal);
+                return true;
+            });
+        }
+
+        void write_header(uint8_t *dst, size_t header_size, size_t nal_size) const {
+            if (out_length_size_ == 0) {
+                memset(dst, 0, header_size - 1);
+                dst[header_size - 1] = 1;
+                return;
+            }
+            for (size_t i = 0; i < header_size; i++) {
+                dst[i] = (uint8_t)(nal_size >> (8 * (header_size - 1 - i)));
+            }
+        }
+
+        void learn_param(const uint8_t *nal, size_t size) {
+            if (size == 0) {
+                return;
+            }
+            int type = nal[0] & 0x1f;
+            if (type == 7) {
+                sps_.assign(nal, nal + size);
+            } else if (type == 8) {
+                pps_.assign(nal, nal + size);
+            } else {
+                return;
+            }
+            params_annexb_.clear();
+            if (sps_.empty() || pps_.empty()) {
+                return;
+            }
+            static const uint8_t start_code[4] = {0, 0, 0, 1};
+            params_annexb_.insert(params_annexb_.end(), start_code, start_code + 4);
+            params_annexb_.insert(params_annexb_.end(), sps_.begin(), sps_.end());
+            params_annexb_.insert(params_annexb_.end(), start_code, start_code + 4);
+            params_annexb_.insert(params_annexb_.end(), pps_.begin(), pps_.end());
+        }
+
+    private:
+        int in_length_size_  = 0;
+        int out_length_size_ = 0;
+
+        std::vector<uint8_t> sps_;
+        std::vector<uint8_t> pps_;
+        std::vector<uint8_t> params_annexb_;
+
+        std::vector<Nal>          nals_;
+        std::vector<uint8_t>      headers_;
+        std::vector<struct iovec> iov_;
+    };
+} // namespace Utils
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Utils {
+
+    // NAL的分隔方式：start code（Annex-B）或者长度前缀（AVCC/hvcC）
+    enum class NalFraming { ANNEXB, AVCC };
+
+    struct NalUnit {
+        const uint8_t *data = nullptr; // NAL头
+        size_t         size = 0;       // 不含start code/长度字段，Annex-B时也不含下一个start code前面的0
+        // 前面的start code（含前导0）或长度字段的字节数；Annex-B的第一个NAL包含它之前的所有字节
+        size_t prefix = 0;
+    };
+
+    /**
+     * @brief 从pos开始找00 00 01，返回它第一个字节的位置，找不到返回size
+     * 0x01在压缩数据里出现得少，用memchr找1再回头检查两个0
+     */
+    inline size_t findStartCode(const uint8_t *data, size_t size, size_t pos) {
+        size_t i = pos + 2;
+        while (i < size) {
+            const uint8_t *p = (const uint8_t *)memchr(data + i, 1, size - i);
+            if (p == nullptr) {
+                break;
+            }
+            i = p - data;
+            if (data[i - 1] == 0 && data[i - 2] == 0) {
+                return i - 2;
+            }
+            // data[i]是1，不可能是后面start code里的0，下一个候选的01至少在i+3
+            i += 3;
+        }
+        return size;
+    }
+
+    /**
+     * @brief 按分隔方式在编译期特化的NAL遍历，内层循环里没有分隔方式的分支
+     * NalIterator<NalFraming::ANNEXB>            start code分隔
+     * NalIterator<NalFraming::AVCC, LengthSize>  1/2/4字节长度前缀
+     * 不知道格式时用forEachNal，只在开始时按length_size分派一次
+     */
+    template <NalFraming Framing, int LengthSize = 0>
+    class NalIterator;
+
+    template <>
+    class NalIterator<NalFraming::ANNEXB, 0> {
+    public:
+        NalIterator(const uint8_t *data, size_t size)
+            : data_(data)
+            , size_(data ? size : 0) {
+            size_t sc = findStartCode(data_, size_, 0);
+            pos_      = sc < size_ ? sc + 3 : size_;
+        }
+
+        bool next(NalUnit &nal) {
+            while (pos_ < size_) {
+                size_t sc  = findStartCode(data_, size_, pos_);
+                size_t end = sc;
+                // NAL的最后一个字节不会是0，后面的0都属于下一个start code；最后一个NAL原样到结尾
+                while (sc < size_ && end > pos_ && data_[end - 1] == 0) {
+                    end--;
+                }
+                size_t begin = pos_;
+                pos_         = sc < size_ ? sc + 3 : size_;
+                if (end == begin) {
+                    continue;
+                }
+                nal.data   = data_ + begin;
+                nal.size   = end - begin;
+                nal.prefix = begin - gap_;
+                gap_       = end;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        const uint8_t *data_ = nullptr;
+        size_t         size_ = 0;
+        size_t         pos_  = 0; // 下一个NAL的第一个字节
+        size_t         gap_  = 0; // 上一个NAL结束的位置
+    };
+
+    template <int LengthSize>
+    class NalIterator<NalFraming::AVCC, LengthSize> {
+        static_assert(LengthSize == 1 || LengthSize == 2 || LengthSize == 4, "nal length size must be 1, 2 or 4");
+
+    public:
+        NalIterator(const uint8_t *data, size_t size)
+            : data_(data)
+            , size_(data ? size : 0) {}
+
+        bool next(NalUnit &nal) {
+            while (pos_ + LengthSize <= size_) {
+                size_t len = 0;
+                for (int i = 0; i < LengthSize; i++) {
+                    len = (len << 8) | data_[pos_ + i];
+                }
+                size_t begin = pos_ + LengthSize;
+                // 长度字段超出数据时截断到结尾
+                size_t n = len < size_ - begin ? len : size_ - begin;
+                pos_     = begin + n;
+                if (n == 0) {
+                    continue;
+                }
+                nal.data   = data_ + begin;
+                nal.size   = n;
+                nal.prefix = LengthSize;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        const uint8_t *data_ = nullptr;
+        size_t         size_ = 0;
+        size_t         pos_  = 0;
+    };
+
+    template <typename Iterator, typename F>
+    inline void walkNals(const uint8_t *data, size_t size, F &f) {
+        Iterator it(data, size);
+        NalUnit  nal;
+        while (it.next(nal) && f(nal)) {
+        }
+    }
+
+    /**
+     * @brief 依次取出每个NAL，f(const NalUnit &)返回false时停止
+     * length_size为0表示Annex-B，否则为长度前缀的字节数；不支持的长度返回-1
+     */
+    template <typename F>
+    inline int forEachNal(const uint8_t *data, size_t size, int length_size, F f) {
+        switch (length_size) {
+        case 0:
+            walkNals<NalIterator<NalFraming::ANNEXB>>(data, size, f);
+            return 0;
+        case 1:
+            walkNals<NalIterator<NalFraming::AVCC, 1>>(data, size, f);
+            return 0;
+        case 2:
+            walkNals<NalIterator<NalFraming::AVCC, 2>>(data, size, f);
+            return 0;
+        case 4:
+            walkNals<NalIterator<NalFraming::AVCC, 4>>(data, size, f);
+            return 0;
+        default:
+            return -1;
+        }
+    }
+} // namespace Utils
@@ -0,0 +1,544 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXFMT_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief 像素格式转换的行内核：I420<->NV12（UV交织/解交织）、P010<->I010（10bit高低位对齐+UV交织）、
+ * YUYV<->I420，以及按stride拷贝平面；另有一行8bit样本的SAD，给编码前的画面变化检测用
+ * 每个内核有标量参考实现和SSE2/AVX2版本，第一次使用时按CPUID选最快的一组；
+ * SIMD版本只处理整块，剩下的尾巴交给标量实现，所以任意宽度的结果都和标量逐字节相同。
+ * AVX2函数用target属性单独编译，不需要给整个工程加-mavx2
+ */
+namespace Utils {
+    namespace PixFmt {
+
+        enum class SimdLevel { SCALAR = 0, SSE2 = 1, AVX2 = 2 };
+
+        inline const char *simdName(SimdLevel level) {
+            switch (level) {
+            case SimdLevel::SSE2:
+                return "sse2";
+            case SimdLevel::AVX2:
+                return "avx2";
+            default:
+                return "scalar";
+            }
+        }
+
+        // 行内核，width为一行的像素数（UV内核为色度像素数），数据不要求对齐
+        struct Kernels {
+            SimdLevel level;
+            // uv[2i] = u[i], uv[2i+1] = v[i]
+            void (*interleaveUV)(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width);
+            void (*deinterleaveUV)(uint8_t *u, uint8_t *v, const uint8_t *uv, int width);
+            // 16bit的交织/解交织，交织时左移shift，解交织时右移shift（I010 <-> P010为6）
+            void (*interleaveUV16)(uint16_t *uv, const uint16_t *u, const uint16_t *v, int width, int shift);
+            void (*deinterleaveUV16)(uint16_t *u, uint16_t *v, const uint16_t *uv, int width, int shift);
+            void (*shiftLeft16)(uint16_t *dst, const uint16_t *src, int width, int shift);
+            void (*shiftRight16)(uint16_t *dst, const uint16_t *src, int width, int shift);
+            // 两行YUYV得到两行Y和一行U/V，色度取两行的平均（四舍五入）；width为偶数
+            void (*yuyvToI420)(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, const uint8_t *yuyv0,
+                               const uint8_t *yuyv1, int width);
+            // 一行Y和对应的一行U/V得到一行YUYV；width为偶数
+            void (*i420ToYuyv)(uint8_t *yuyv, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width);
+            // sum(|a[i] - b[i]|)，width个8bit样本
+            uint32_t (*sad)(const uint8_t *a, const uint8_t *b, int width);
+        };
+
+        namespace Scalar {
+            inline void interleaveUV(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width) {
+                for (int i = 0; i < width; i++) {
+                    uv[2 * i]     = u[i];
+                    uv[2 * i + 1] = v[i];
+                }
+            }
+
+            inline void deinterleaveUV(uint8_t *u, uint8_t *v, const uint8_t *uv, int width) {
+                for (int i = 0; i < width; i++) {
+                    u[i] = uv[2 * i];
+                    v[i] = uv[2 * i + 1];
+                }
+            }
+
+            inline void interleaveUV16(uint16_t *uv, const uint16_t *u, const uint16_t *v, int width, int shift) {
+                for (int i = 0; i < width; i++) {
+                    uv[2 * i]     = (uint16_t)(u[i] << shift);
+                    uv[2 * i + 1] = (uint16_t)(v[i] << shift);
+                }
+            }
+
+            inline void deinterleaveUV16(uint16_t *u, uint16_t *v, const uint16_t *uv, int width, int shift) {
+                for (int i = 0; i < width; i++) {
+                    u[i] = uv[2 * i] >> shift;
+                    v[i] = uv[2 * i + 1] >> shift;
+                }
+            }
+
+            inline void shiftLeft16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                for (int i = 0; i < width; i++) {
+                    dst[i] = (uint16_t)(src[i] << shift);
+                }
+            }
+
+            inline void shiftRight16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                for (int i = 0; i < width; i++) {
+                    dst[i] = src[i] >> shift;
+                }
+            }
+
+            inline void yuyvToI420(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, const uint8_t *yuyv0,
+                                   const uint8_t *yuyv1, int width) {
+                for (int i = 0; i < width / 2; i++) {
+                    const uint8_t *a = yuyv0 + 4 * i;
+                    const uint8_t *b = yuyv1 + 4 * i;
+
+                    y0[2 * i]     = a[0];
+                    y0[2 * i + 1] = a[2];
+                    y1[2 * i]     = b[0];
+                    y1[2 * i + 1] = b[2];
+                    u[i]          = (uint8_t)((a[1] + b[1] + 1) >> 1);
+                    v[i]          = (uint8_t)((a[3] + b[3] + 1) >> 1);
+                }
+            }
+
+            inline void i420ToYuyv(uint8_t *yuyv, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width) {
+                for (int i = 0; i < width / 2; i++) {
+                    yuyv[4 * i]     = y[2 * i];
+                    yuyv[4 * i + 1] = u[i];
+                    yuyv[4 * i + 2] = y[2 * i + 1];
+                    yuyv[4 * i + 3] = v[i];
+                }
+            }
+
+            inline uint32_t sad(const uint8_t *a, const uint8_t *b, int width) {
+                uint32_t sum = 0;
+                for (int i = 0; i < width; i++) {
+                    sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+                }
+                return sum;
+            }
+        } // namespace Scalar
+
+#ifdef PIXFMT_X86
+        namespace Sse2 {
+            inline void interleaveUV(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width) {
+                int i = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+                    __m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+                    _mm_storeu_si128((__m128i *)(uv + 2 * i), _mm_unpacklo_epi8(a, b));
+                    _mm_storeu_si128((__m128i *)(uv + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+                }
+                Scalar::interleaveUV(uv + 2 * i, u + i, v + i, width - i);
+            }
+
+            inline void deinterleaveUV(uint8_t *u, uint8_t *v, const uint8_t *uv, int width) {
+                const __m128i mask = _mm_set1_epi16(0x00ff);
+                int           i    = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+                    __m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+                    _mm_storeu_si128((__m128i *)(u + i),
+                                     _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+                    _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+                }
+                Scalar::deinterleaveUV(u + i, v + i, uv + 2 * i, width - i);
+            }
+
+            inline void interleaveUV16(uint16_t *uv, const uint16_t *u, const uint16_t *v, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 8 <= width; i += 8) {
+                    __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(u + i)), count);
+                    __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(v + i)), count);
+                    _mm_storeu_si128((__m128i *)(uv + 2 * i), _mm_unpacklo_epi16(a, b));
+                    _mm_storeu_si128((__m128i *)(uv + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+                }
+                Scalar::interleaveUV16(uv + 2 * i, u + i, v + i, width - i, shift);
+            }
+
+            // 先移位，再把32bit里的高低16bit分开：符号扩展后packs_epi32能原样还原16bit
+            inline void deinterleaveUV16(uint16_t *u, uint16_t *v, const uint16_t *uv, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 8 <= width; i += 8) {
+                    __m128i a  = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(uv + 2 * i)), count);
+                    __m128i b  = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(uv + 2 * i + 8)), count);
+                    __m128i ua = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+                    __m128i ub = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+                    _mm_storeu_si128((__m128i *)(u + i), _mm_packs_epi32(ua, ub));
+                    _mm_storeu_si128((__m128i *)(v + i), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+                }
+                Scalar::deinterleaveUV16(u + i, v + i, uv + 2 * i, width - i, shift);
+            }
+
+            inline void shiftLeft16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 8 <= width; i += 8) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+                    _mm_storeu_si128((__m128i *)(dst + i), _mm_sll_epi16(a, count));
+                }
+                Scalar::shiftLeft16(dst + i, src + i, width - i, shift);
+            }
+
+            inline void shiftRight16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 8 <= width; i += 8) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+                    _mm_storeu_si128((__m128i *)(dst + i), _mm_srl_epi16(a, count));
+                }
+                Scalar::shiftRight16(dst + i, src + i, width - i, shift);
+            }
+
+            // 每次16个像素：偶数字节是Y，奇数字节是交织的UV
+            inline void yuyvToI420(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, const uint8_t *yuyv0,
+                                   const uint8_t *yuyv1, int width) {
+                const __m128i mask = _mm_set1_epi16(0x00ff);
+                int           i    = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m128i a0 = _mm_loadu_si128((const __m128i *)(yuyv0 + 2 * i));
+                    __m128i a1 = _mm_loadu_si128((const __m128i *)(yuyv0 + 2 * i + 16));
+                    __m128i b0 = _mm_loadu_si128((const __m128i *)(yuyv1 + 2 * i));
+                    __m128i b1 = _mm_loadu_si128((const __m128i *)(yuyv1 + 2 * i + 16));
+                    _mm_storeu_si128((__m128i *)(y0 + i),
+                                     _mm_packus_epi16(_mm_and_si128(a0, mask), _mm_and_si128(a1, mask)));
+                    _mm_storeu_si128((__m128i *)(y1 + i),
+                                     _mm_packus_epi16(_mm_and_si128(b0, mask), _mm_and_si128(b1, mask)));
+                    __m128i ca = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+                    __m128i cb = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+                    __m128i c    = _mm_avg_epu8(ca, cb);
+                    __m128i zero = _mm_setzero_si128();
+                    _mm_storel_epi64((__m128i *)(u + i / 2), _mm_packus_epi16(_mm_and_si128(c, mask), zero));
+                    _mm_storel_epi64((__m128i *)(v + i / 2), _mm_packus_epi16(_mm_srli_epi16(c, 8), zero));
+                }
+                Scalar::yuyvToI420(y0 + i, y1 + i, u + i / 2, v + i / 2, yuyv0 + 2 * i, yuyv1 + 2 * i, width - i);
+            }
+
+            inline void i420ToYuyv(uint8_t *yuyv, const uint8_t *y, const uint8_t *u, const uint8_t *v, int width) {
+                int i = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m128i yy = _mm_loadu_si128((const __m128i *)(y + i));
+                    __m128i uu = _mm_loadl_epi64((const __m128i *)(u + i / 2));
+                    __m128i vv = _mm_loadl_epi64((const __m128i *)(v + i / 2));
+                    __m128i uv = _mm_unpacklo_epi8(uu, vv);
+                    _mm_storeu_si128((__m128i *)(yuyv + 2 * i), _mm_unpacklo_epi8(yy, uv));
+                    _mm_storeu_si128((__m128i *)(yuyv + 2 * i + 16), _mm_unpackhi_epi8(yy, uv));
+                }
+                Scalar::i420ToYuyv(yuyv + 2 * i, y + i, u + i / 2, v + i / 2, width - i);
+            }
+
+            // psadbw每8个字节得到一个64bit的和
+            inline uint32_t sad(const uint8_t *a, const uint8_t *b, int width) {
+                __m128i sum = _mm_setzero_si128();
+                int     i   = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+                    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+                    sum       = _mm_add_epi64(sum, _mm_sad_epu8(x, y));
+                }
+                sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+                return (uint32_t)_mm_cvtsi128_si32(sum) + Scalar::sad(a + i, b + i, width - i);
+            }
+        } // namespace Sse2
+
+        // 256bit的unpack/pack都在128bit的两半里各自进行，结果要用permute调整顺序
+        namespace Avx2 {
+#define PIXFMT_AVX2 __attribute__((target("avx2")))
+
+            PIXFMT_AVX2 inline void interleaveUV(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width) {
+                int i = 0;
+                for (; i + 32 <= width; i += 32) {
+                    __m256i a  = _mm256_loadu_si256((const __m256i *)(u + i));
+                    __m256i b  = _mm256_loadu_si256((const __m256i *)(v + i));
+                    __m256i lo = _mm256_unpacklo_epi8(a, b);
+                    __m256i hi = _mm256_unpackhi_epi8(a, b);
+                    _mm256_storeu_si256((__m256i *)(uv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+                    _mm256_storeu_si256((__m256i *)(uv + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+                }
+                Sse2::interleaveUV(uv + 2 * i, u + i, v + i, width - i);
+            }
+
+            PIXFMT_AVX2 inline void deinterleaveUV(uint8_t *u, uint8_t *v, const uint8_t *uv, int width) {
+                const __m256i mask = _mm256_set1_epi16(0x00ff);
+                int           i    = 0;
+                for (; i + 32 <= width; i += 32) {
+                    __m256i a  = _mm256_loadu_si256((const __m256i *)(uv + 2 * i));
+                    __m256i b  = _mm256_loadu_si256((const __m256i *)(uv + 2 * i + 32));
+                    __m256i uu = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+                    __m256i vv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+                    _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(uu, 0xd8));
+                    _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(vv, 0xd8));
+                }
+                Sse2::deinterleaveUV(u + i, v + i, uv + 2 * i, width - i);
+            }
+
+            PIXFMT_AVX2 inline void interleaveUV16(uint16_t *uv, const uint16_t *u, const uint16_t *v, int width,
+                                                   int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m256i a  = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i *)(u + i)), count);
+                    __m256i b  = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i *)(v + i)), count);
+                    __m256i lo = _mm256_unpacklo_epi16(a, b);
+                    __m256i hi = _mm256_unpackhi_epi16(a, b);
+                    _mm256_storeu_si256((__m256i *)(uv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+                    _mm256_storeu_si256((__m256i *)(uv + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+                }
+                Sse2::interleaveUV16(uv + 2 * i, u + i, v + i, width - i, shift);
+            }
+
+            PIXFMT_AVX2 inline void deinterleaveUV16(uint16_t *u, uint16_t *v, const uint16_t *uv, int width,
+                                                     int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m256i a  = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(uv + 2 * i)), count);
+                    __m256i b  = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(uv + 2 * i + 16)), count);
+                    __m256i ua = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+                    __m256i ub = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+                    __m256i uu = _mm256_packs_epi32(ua, ub);
+                    __m256i vv = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+                    _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(uu, 0xd8));
+                    _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(vv, 0xd8));
+                }
+                Sse2::deinterleaveUV16(u + i, v + i, uv + 2 * i, width - i, shift);
+            }
+
+            PIXFMT_AVX2 inline void shiftLeft16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+                    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_sll_epi16(a, count));
+                }
+                Sse2::shiftLeft16(dst + i, src + i, width - i, shift);
+            }
+
+            PIXFMT_AVX2 inline void shiftRight16(uint16_t *dst, const uint16_t *src, int width, int shift) {
+                const __m128i count = _mm_cvtsi32_si128(shift);
+                int           i     = 0;
+                for (; i + 16 <= width; i += 16) {
+                    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+                    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_srl_epi16(a, count));
+                }
+                Sse2::shiftRight16(dst + i, src + i, width - i, shift);
+            }
+
+            PIXFMT_AVX2 inline void yuyvToI420(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                               const uint8_t *yuyv0, const uint8_t *yuyv1, int width) {
+                const __m256i mask = _mm256_set1_epi16(0x00ff);
+                int           i    = 0;
+                for (; i + 32 <= width; i += 32) {
+                    __m256i a0 = _mm256_loadu_si256((const __m256i *)(yuyv0 + 2 * i));
+                    __m256i a1 = _mm256_loadu_si256((const __m256i *)(yuyv0 + 2 * i + 32));
+                    __m256i b0 = _mm256_loadu_si256((const __m256i *)(yuyv1 + 2 * i));
+                    __m256i b1 = _mm256_loadu_si256((const __m256i *)(yuyv1 + 2 * i + 32));
+                    __m256i ya = _mm256_packus_epi16(_mm256_and_si256(a0, mask), _mm256_and_si256(a1, mask));
+                    __m256i yb = _mm256_packus_epi16(_mm256_and_si256(b0, mask), _mm256_and_si256(b1, mask));
+                    _mm256_storeu_si256((__m256i *)(y0 + i), _mm256_permute4x64_epi64(ya, 0xd8));
+                    _mm256_storeu_si256((__m256i *)(y1 + i), _mm256_permute4x64_epi64(yb, 0xd8));
+                    // 两行的色度按同样的顺序打包，平均之后再调整顺序
+                    __m256i ca = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8));
+                    __m256i cb = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+                    __m256i c  = _mm256_permute4x64_epi64(_mm256_avg_epu8(ca, cb), 0xd8);
+                    __m256i uv = _mm256_packus_epi16(_mm256_and_si256(c, mask), _mm256_srli_epi16(c, 8));
+                    uv         = _mm256_permute4x64_epi64(uv, 0xd8);
+                    _mm_storeu_si128((__m128i *)(u + i / 2), _mm256_castsi256_si128(uv));
+                    _mm_storeu_si128((__m128i *)(v + i / 2), _mm256_extracti128_si256(uv, 1));
+                }
+                Sse2::yuyvToI420(y0 + i, y1 + i, u + i / 2, v + i / 2, yuyv0 + 2 * i, yuyv1 + 2 * i, width - i);
+            }
+
+            PIXFMT_AVX2 inline void i420ToYuyv(uint8_t *yuyv, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                               int width) {
+                int i = 0;
+                for (; i + 32 <= width; i += 32) {
+                    __m256i yy = _mm256_loadu_si256((const __m256i *)(y + i));
+                    __m128i uu = _mm_loadu_si128((const __m128i *)(u + i / 2));
+                    __m128i vv = _mm_loadu_si128((const __m128i *)(v + i / 2));
+                    // 两半分别是第0-7和8-15对UV，和Y的两半对应
+                    __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(uu, vv)),
+                                                         _mm_unpackhi_epi8(uu, vv), 1);
+                    __m256i lo = _mm256_unpacklo_epi8(yy, uv);
+                    __m256i hi = _mm256_unpackhi_epi8(yy, uv);
+                    _mm256_storeu_si256((__m256i *)(yuyv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+                    _mm256_storeu_si256((__m256i *)(yuyv + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+                }
+                Sse2::i420ToYuyv(yuyv + 2 * i, y + i, u + i / 2, v + i / 2, width - i);
+            }
+
+            PIXFMT_AVX2 inline uint32_t sad(const uint8_t *a, const uint8_t *b, int width) {
+                __m256i sum = _mm256_setzero_si256();
+                int     i   = 0;
+                for (; i + 32 <= width; i += 32) {
+                    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+                    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+                    sum       = _mm256_add_epi64(sum, _mm256_sad_epu8(x, y));
+                }
+                __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+                half         = _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+                return (uint32_t)_mm_cvtsi128_si32(half) + Sse2::sad(a + i, b + i, width - i);
+            }
+
+#undef PIXFMT_AVX2
+        } // namespace Avx2
+#endif
+
+        inline SimdLevel detectSimdLevel() {
+#ifdef PIXFMT_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return SimdLevel::AVX2;
+            }
+            if (__builtin_cpu_supports("sse2")) {
+                return SimdLevel::SSE2;
+            }
+#endif
+            return SimdLevel::SCALAR;
+        }
+
+        // 指定级别的内核，CPU不支持时降到支持的最高级别
+        inline const Kernels &kernels(SimdLevel level) {
+            static const Kernels scalar = {SimdLevel::SCALAR,     Scalar::interleaveUV,   Scalar::deinterleaveUV,
+                                           Scalar::interleaveUV16, Scalar::deinterleaveUV16, Scalar::shiftLeft16,
+                                           Scalar::shiftRight16,  Scalar::yuyvToI420,     Scalar::i420ToYuyv,
+                                           Scalar::sad};
+#ifdef PIXFMT_X86
+            static const Kernels sse2 = {SimdLevel::SSE2,     Sse2::interleaveUV,   Sse2::deinterleaveUV,
+                                         Sse2::interleaveUV16, Sse2::deinterleaveUV16, Sse2::shiftLeft16,
+                                         Sse2::shiftRight16,  Sse2::yuyvToI420,     Sse2::i420ToYuyv,
+                                         Sse2::sad};
+            static const Kernels avx2 = {SimdLevel::AVX2,     Avx2::interleaveUV,   Avx2::deinterleaveUV,
+                                         Avx2::interleaveUV16, Avx2::deinterleaveUV16, Avx2::shiftLeft16,
+                                         Avx2::shiftRight16,  Avx2::yuyvToI420,     Avx2::i420ToYuyv,
+                                         Avx2::sad};
+            static const SimdLevel supported = detectSimdLevel();
+            if (level > supported) {
+                level = supported;
+            }
+            if (level == SimdLevel::AVX2) {
+                return avx2;
+            }
+            if (level == SimdLevel::SSE2) {
+                return sse2;
+            }
+#else
+            (void)level;
+#endif
+            return scalar;
+        }
+
+        // CPU支持的最快的一组
+        inline const Kernels &kernels() {
+            return kernels(SimdLevel::AVX2);
+        }
+
+        /**
+         * 以下为整帧转换，stride都是字节数，width/height为亮度的像素数；
+         * 4:2:0的色度宽高向上取整，YUYV要求width为偶数
+         */
+
+        // 按行拷贝一个平面，stride都等于行字节数时一次拷贝
+        inline void copyPlane(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride, int row_bytes,
+                              int height) {
+            if (dst_stride == row_bytes && src_stride == row_bytes) {
+                memcpy(dst, src, (size_t)row_bytes * height);
+                return;
+            }
+            for (int y = 0; y < height; y++) {
+                memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, row_bytes);
+            }
+        }
+
+        inline void i420ToNv12(const uint8_t *src_y, int src_stride_y, const uint8_t *src_u, int src_stride_u,
+                               const uint8_t *src_v, int src_stride_v, uint8_t *dst_y, int dst_stride_y,
+                               uint8_t *dst_uv, int dst_stride_uv, int width, int height,
+                               const Kernels &k = kernels()) {
+            int cw = (width + 1) / 2;
+            int ch = (height + 1) / 2;
+            copyPlane(dst_y, dst_stride_y, src_y, src_stride_y, width, height);
+            for (int y = 0; y < ch; y++) {
+                k.interleaveUV(dst_uv + (size_t)y * dst_stride_uv, src_u + (size_t)y * src_stride_u,
+                               src_v + (size_t)y * src_stride_v, cw);
+            }
+        }
+
+        inline void nv12ToI420(const uint8_t *src_y, int src_stride_y, const uint8_t *src_uv, int src_stride_uv,
+                               uint8_t *dst_y, int dst_stride_y, uint8_t *dst_u, int dst_stride_u, uint8_t *dst_v,
+                               int dst_stride_v, int width, int height, const Kernels &k = kernels()) {
+            int cw = (width + 1) / 2;
+            int ch = (height + 1) / 2;
+            copyPlane(dst_y, dst_stride_y, src_y, src_stride_y, width, height);
+            for (int y = 0; y < ch; y++) {
+                k.deinterleaveUV(dst_u + (size_t)y * dst_stride_u, dst_v + (size_t)y * dst_stride_v,
+                                 src_uv + (size_t)y * src_stride_uv, cw);
+            }
+        }
+
+        // I010（yuv420p10le，低10位有效）-> P010（高10位有效，UV交织）
+        inline void i010ToP010(const uint8_t *src_y, int src_stride_y, const uint8_t *src_u, int src_stride_u,
+                               const uint8_t *src_v, int src_stride_v, uint8_t *dst_y, int dst_stride_y,
+                               uint8_t *dst_uv, int dst_stride_uv, int width, int height,
+                               const Kernels &k = kernels()) {
+            int cw = (width + 1) / 2;
+            int ch = (height + 1) / 2;
+            for (int y = 0; y < height; y++) {
+                k.shiftLeft16((uint16_t *)(dst_y + (size_t)y * dst_stride_y),
+                              (const uint16_t *)(src_y + (size_t)y * src_stride_y), width, 6);
+            }
+            for (int y = 0; y < ch; y++) {
+                k.interleaveUV16((uint16_t *)(dst_uv + (size_t)y * dst_stride_uv),
+                                 (const uint16_t *)(src_u + (size_t)y * src_stride_u),
+                                 (const uint16_t *)(src_v + (size_t)y * src_stride_v), cw, 6);
+            }
+        }
+
+        inline void p010ToI010(const uint8_t *src_y, int src_stride_y, const uint8_t *src_uv, int src_stride_uv,
+                               uint8_t *dst_y, int dst_stride_y, uint8_t *dst_u, int dst_stride_u, uint8_t *dst_v,
+                               int dst_stride_v, int width, int height, const Kernels &k = kernels()) {
+            int cw = (width + 1) / 2;
+            int ch = (height + 1) / 2;
+            for (int y = 0; y < height; y++) {
+                k.shiftRight16((uint16_t *)(dst_y + (size_t)y * dst_stride_y),
+                               (const uint16_t *)(src_y + (size_t)y * src_stride_y), width, 6);
+            }
+            for (int y = 0; y < ch; y++) {
+                k.deinterleaveUV16((uint16_t *)(dst_u + (size_t)y * dst_stride_u),
+                                   (uint16_t *)(dst_v + (size_t)y * dst_stride_v),
+                                   (const uint16_t *)(src_uv + (size_t)y * src_stride_uv), cw, 6);
+            }
+        }
+
+        // 色度取上下两行的平均；高度为奇数时最后一行和自己平均
+        inline void yuyvToI420(const uint8_t *src, int src_stride, uint8_t *dst_y, int dst_stride_y, uint8_t *dst_u,
+                               int dst_stride_u, uint8_t *dst_v, int dst_stride_v, int width, int height,
+                               const Kernels &k = kernels()) {
+            for (int y = 0; y < height; y += 2) {
+                int            next = y + 1 < height ? y + 1 : y;
+                const uint8_t *row1 = src + (size_t)next * src_stride;
+                k.yuyvToI420(dst_y + (size_t)y * dst_stride_y, dst_y + (size_t)next * dst_stride_y,
+                             dst_u + (size_t)(y / 2) * dst_stride_u, dst_v + (size_t)(y / 2) * dst_stride_v,
+                             src + (size_t)y * src_stride, row1, width);
+            }
+        }
+
+        // 每两行YUYV共用一行色度
+        inline void i420ToYuyv(const uint8_t *src_y, int src_stride_y, const uint8_t *src_u, int src_stride_u,
+                               const uint8_t *src_v, int src_stride_v, uint8_t *dst, int dst_stride, int width,
+                               int height, const Kernels &k = kernels()) {
+            for (int y = 0; y < height; y++) {
+                k.i420ToYuyv(dst + (size_t)y * dst_stride, src_y + (size_t)y * src_stride_y,
+                             src_u + (size_t)(y / 2) * src_stride_u, src_v + (size_t)(y / 2) * src_stride_v, width);
+            }
+        }
+    } // namespace PixFmt
+} // namespace Utils